@@ -7,6 +7,12 @@
 #define CHIP8_VARIABLE_REGISTERS 16
 #define CHIP8_STACK_HEIGHT 16
 #define CHIP8_ROM_BYTES 3584
+#define CHIP8_FONT_BYTES 80
+#define CHIP8_PAGE_BYTES 256
+#define CHIP8_RAM_PAGES (CHIP8_RAM_BYTES / CHIP8_PAGE_BYTES)
+
+#include <cstddef>
+#include <memory>
 
 // 16 bit type
 typedef unsigned short word;
@@ -14,42 +20,158 @@ typedef unsigned short word;
 // 8 bit type
 typedef unsigned char byte;
 
+// 64 bit type, one display row
+typedef unsigned long long qword;
+
 word combine(byte leftByte, byte rightByte);
 
-class Chip8 {
-public:
-    
-    // Blocks/containers
-    
-    byte ram[CHIP8_RAM_BYTES];
+// Sprite row placed at column x of a display row, clipped at the right edge
+inline qword spriteMask(byte spriteRow, int x) {
+    if (x <= CHIP8_SCREEN_WIDTH - 8) {
+        return (qword) spriteRow << (CHIP8_SCREEN_WIDTH - 8 - x);
+    }
+    return (qword) spriteRow >> (x - (CHIP8_SCREEN_WIDTH - 8));
+}
+
+// Hex digit sprites 0-F, loaded at 0x050
+extern const byte chip8Font[CHIP8_FONT_BYTES];
+
+// Why a machine stopped. cycle() does nothing once fault is set.
+enum Chip8Fault : byte {
+    CHIP8_FAULT_NONE = 0,
+    CHIP8_FAULT_BAD_OPCODE,         // No handler for the top nibble
+    CHIP8_FAULT_STACK_OVERFLOW,     // 2NNN with a full stack
+    CHIP8_FAULT_STACK_UNDERFLOW,    // 00EE with an empty stack
+    CHIP8_FAULT_RAM_RANGE,          // Fetch, draw or FX33/55/65 past the end of RAM
+    CHIP8_FAULT_BAD_KEY,            // EX9E/EXA1 with VX above F
+};
+
+const char * faultName(Chip8Fault fault);
+
+#ifdef CHIP8_PROFILE
+// Execution counts gathered by cycle() when built with CHIP8_PROFILE
+struct Chip8Profile {
+    unsigned long cycles;
+    unsigned long opcodeFamily[16];             // By top nibble
+    unsigned int address[CHIP8_RAM_BYTES];      // By PC at fetch
+    unsigned long keyWaitCycles;                // FX0A re-executed waiting for a key
+    unsigned long draws;                        // DXYN executed
+    unsigned long frames;                       // Frames presented, counted by the frontend
+};
+#endif
+
+// One page of RAM held by snapshots; never written once built.
+// Ids are unique for the life of the process, so a machine can tell
+// whether its RAM page still matches one without keeping it alive.
+struct Chip8Page {
+    unsigned long id;
+    byte bytes[CHIP8_PAGE_BYTES];
+};
+
+// A saved machine. Snapshots taken from a machine restored from another
+// snapshot share every RAM page the machine has not written since.
+struct Chip8Snapshot {
+    std::shared_ptr<const Chip8Page> pages[CHIP8_RAM_PAGES];
+
     byte variableRegisters[CHIP8_VARIABLE_REGISTERS];
     word stack[CHIP8_STACK_HEIGHT];
-    
-    // Words
-    
     byte stackPointer;
     word programCounter;
     word indexRegister;
-    
-    // Bytes
-    
     byte delayTimer;
     byte soundTimer;
-        
-    // Display buffer: displayBuffer[y][x] = 0x01, on / 0x00, off
-    byte displayBuffer[CHIP8_SCREEN_HEIGHT][CHIP8_SCREEN_WIDTH];
-
+    qword displayBuffer[CHIP8_SCREEN_HEIGHT];
     bool draw;
     bool sound;
     bool copyBeforeShifting;
     bool blockingForKey;
-
     byte keyState[16];
     byte lastKey;
     bool lastKeyFromBlock;
+    Chip8Fault fault;
+};
+
+// Hot state leads the object: one 64-byte line holds the registers, keys and
+// flags every cycle touches, and the next starts with the call stack. The
+// display is bit-packed and RAM comes last.
+class alignas(64) Chip8 {
+public:
+
+    // Words
+
+    word programCounter;
+    word indexRegister;
+
+    // Bytes
+
+    byte stackPointer;
+    byte delayTimer;
+    byte soundTimer;
+    byte lastKey;
+
+    byte variableRegisters[CHIP8_VARIABLE_REGISTERS];
+    byte keyState[16];
+
+    bool draw;
+    bool sound;
+    bool copyBeforeShifting;
+    bool blockingForKey;
+    bool lastKeyFromBlock;
+
+    // Set instead of executing anything that would leave the machine's memory
+    Chip8Fault fault;
+
+    // RAM pages written since the last snapshot()/resetTo(), one bit per page
+    unsigned int dirtyPages;
+
+    // Blocks/containers
+
+    // Only calls and returns touch it, so it opens the second line
+    alignas(64) word stack[CHIP8_STACK_HEIGHT];
+
+    // Id of the snapshot page each RAM page last matched, 0 for none
+    unsigned long pageOrigin[CHIP8_RAM_PAGES];
+
+    // Display buffer: pixel x of row y is bit (63 - x) of displayBuffer[y]
+    qword displayBuffer[CHIP8_SCREEN_HEIGHT];
+
+    alignas(64) byte ram[CHIP8_RAM_BYTES];
+
+#ifdef CHIP8_PROFILE
+    Chip8Profile profile;
+
+    // Fill out with up to count PCs, hottest first; returns how many
+    int hottestAddresses(word * out, int count) const;
+
+    // Flat profile: opcode families, hottest addresses, FX0A and draw totals
+    void dumpProfile();
+#endif
+
+    bool pixel(int x, int y) const {
+        return (displayBuffer[y] >> (CHIP8_SCREEN_WIDTH - 1 - x)) & 1;
+    }
+
+    // Honour the line alignment for heap instances without C++17 aligned new
+    static void * operator new(size_t size);
+    static void operator delete(void * p);
+
+    void markDirty(word address, int length) {
+        for (int page = address / CHIP8_PAGE_BYTES; page <= (address + length - 1) / CHIP8_PAGE_BYTES; page++) {
+            dirtyPages |= 1u << (page % CHIP8_RAM_PAGES);
+        }
+    }
 
     void execute(word opcode);
 
+    // Fault unless [address, address + length) lies inside RAM
+    bool checkRange(int address, int length) {
+        if (address + length > CHIP8_RAM_BYTES) {
+            fault = CHIP8_FAULT_RAM_RANGE;
+            return false;
+        }
+        return true;
+    }
+
     void executeKeyInstruction(word opcode, byte X);
 
     void executeMiscInstruction(word opcode, byte X);
@@ -160,7 +282,17 @@ public:
     Chip8();
     void cycle();
     void reset();
-    void load(byte * rom);
+    void load(const byte * rom);
+
+    // Copy of the whole machine; every member is plain data, so this is a memcpy
+    Chip8 clone() const { return *this; }
+
+    // Save the machine. Pages not written since resetTo(*base) are shared with base.
+    Chip8Snapshot snapshot(const Chip8Snapshot * base = nullptr);
+
+    // Restore a snapshot, copying only the RAM pages that differ from it
+    void resetTo(const Chip8Snapshot &snap);
+
     void dumpState();
     void dumpDisplay();
 };
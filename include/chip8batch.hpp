@@ -0,0 +1,121 @@
+#ifndef CHIP8BATCH_HPP
+#define CHIP8BATCH_HPP
+
+#include "chip8.hpp"
+#include <vector>
+
+// Lane counts are padded up to this so the vector kernels never need a tail
+#define CHIP8_BATCH_LANE_ALIGN 32
+
+// Many independent machines running the same ROM, stored as structure-of-arrays.
+//
+// Per-lane registers, timers and the stack are laid out lane-minor, so
+// variableRegisters[reg * stride + lane] for every lane is one contiguous row.
+// While every live lane has the same PC and the same opcode there, step()
+// executes the instruction once for all lanes (with AVX2 when built with it
+// and the CPU has it); otherwise each lane is stepped on its own. Semantics mirror Chip8::cycle(),
+// quirks included, so a lane matches a Chip8 fed the same ROM and keys
+// (CXNN aside, since the lanes draw from rand() in a different order).
+class Chip8Batch {
+public:
+
+    // SoA state, indexed [row * stride + lane]
+
+    std::vector<byte> variableRegisters;
+    std::vector<word> stack;
+    std::vector<byte> stackPointer;
+    std::vector<word> programCounter;
+    std::vector<word> indexRegister;
+    std::vector<byte> delayTimer;
+    std::vector<byte> soundTimer;
+
+    // Per-lane blocks, indexed [lane * size + offset]
+
+    std::vector<byte> ram;
+    std::vector<qword> displayBuffer;
+    std::vector<byte> keyState;
+
+    // Per-lane flags, indexed [lane]
+
+    std::vector<byte> draw;
+    std::vector<byte> sound;
+    std::vector<byte> blockingForKey;
+    std::vector<byte> lastKey;
+    std::vector<byte> lastKeyFromBlock;
+
+    // Chip8Fault that stopped the lane, 0 while it runs
+    std::vector<byte> fault;
+
+    bool copyBeforeShifting;
+
+    // Step counters, in lane-steps
+    unsigned long lockstepSteps;
+    unsigned long divergentSteps;
+
+    Chip8Batch(int lanes);
+
+    int lanes() const { return laneCount; }
+    int stride() const { return laneStride; }
+
+    void reset();
+    void load(const byte * rom);
+    void step();
+    void run(int cycles);
+
+    byte * laneRam(int lane) { return &ram[lane * CHIP8_RAM_BYTES]; }
+    qword * laneDisplay(int lane) { return &displayBuffer[lane * CHIP8_SCREEN_HEIGHT]; }
+    byte * laneKeys(int lane) { return &keyState[lane * 16]; }
+
+    // Move one lane in or out of a standalone machine
+    void copyLaneTo(int lane, Chip8 &out) const;
+    void copyLaneFrom(int lane, const Chip8 &in);
+
+private:
+    int laneCount;
+    int laneStride;
+    int haltedCount;
+
+    // RAM pages any lane has written since load(), one bit per page. Lanes
+    // only compare opcodes when lockstep fetches from one of these.
+    unsigned int writtenPages;
+
+    // PCs may no longer agree after the last step
+    bool mayDiverge;
+
+    // Every live lane had the same PC when last checked
+    bool converged;
+
+    // First lane that hasn't faulted; its PC is the lockstep PC
+    int leadLane;
+
+    // Halted lanes' registers, held across a lockstep step so the row kernels
+    // (which run over every lane) leave a faulted lane as it stopped
+    struct ParkedLane {
+        int lane;
+        byte registers[CHIP8_VARIABLE_REGISTERS];
+        word programCounter;
+        word indexRegister;
+        byte delayTimer;
+        byte soundTimer;
+        byte sound;
+    };
+    std::vector<ParkedLane> parked;
+
+    byte * row(int reg) { return &variableRegisters[reg * laneStride]; }
+
+    bool pcsAgree(int &lead) const;
+    bool opcodesAgree(word pc) const;
+    bool stepLockstep();
+    void executeVector(word opcode);
+    bool callVector(word NNN);
+    bool returnVector();
+    void markWritten(word first, word last);
+    void parkHalted();
+    void unparkHalted();
+    void haltLane(int lane, Chip8Fault why);
+    void stepLane(int lane);
+    void executeLane(int lane, word opcode);
+    void drawLane(int lane, byte X, byte Y, byte N);
+};
+
+#endif // CHIP8BATCH_HPP
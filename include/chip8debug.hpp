@@ -0,0 +1,101 @@
+#ifndef CHIP8DEBUG_HPP
+#define CHIP8DEBUG_HPP
+
+#include "chip8.hpp"
+#include <vector>
+
+class Chip8Tracer;
+
+// Condition PC meaning "at every instruction"
+#define CHIP8_DEBUG_ANY_PC 0xFFFF
+
+enum Chip8StopReason : byte {
+    CHIP8_STOP_NONE = 0,
+    CHIP8_STOP_BREAKPOINT,          // PC breakpoint
+    CHIP8_STOP_CONDITION,           // Register condition held
+    CHIP8_STOP_READ,                // DXYN or FX65 about to read a watched range
+    CHIP8_STOP_WRITE,               // FX33 or FX55 about to write a watched range
+    CHIP8_STOP_FAULT,               // The machine faulted
+};
+
+enum Chip8Compare : byte {
+    CHIP8_COMPARE_EQ = 0,           // ==
+    CHIP8_COMPARE_NE,               // !=
+    CHIP8_COMPARE_LT,               // <
+    CHIP8_COMPARE_LE,               // <=
+    CHIP8_COMPARE_GT,               // >
+    CHIP8_COMPARE_GE,               // >=
+};
+
+// Break at pc (or anywhere) when VX starts comparing true against value.
+// Edge-triggered: a condition that stays true stops once, and again only
+// after it has been false (for a pc condition, leaving pc counts).
+struct Chip8Condition {
+    word pc;
+    byte X;
+    Chip8Compare compare;
+    byte value;
+};
+
+// Inclusive RAM range
+struct Chip8Watch {
+    word first;
+    word last;
+    bool onRead;
+    bool onWrite;
+};
+
+// Breakpoints and watchpoints for one machine.
+//
+// Chip8::cycle() knows nothing about them: callers run the machine through
+// run() only while active(), and call cycle() directly otherwise, so a
+// session with nothing set pays nothing. Stops happen before the instruction
+// executes; the next run() steps over it.
+class Chip8Debugger {
+public:
+    Chip8 &machine;
+
+    // When set, instructions run through it so they land in the trace
+    Chip8Tracer * tracer;
+
+    Chip8StopReason stopReason;
+    word stopPc;
+    word stopAddress;               // First watched byte touched, for READ/WRITE
+
+    Chip8Debugger(Chip8 &machine);
+
+    bool active() const { return breakpointCount || !conditions.empty() || !watches.empty(); }
+
+    void setBreakpoint(word pc, bool on);
+    bool hasBreakpoint(word pc) const { return (breakpoints[pc / 64] >> (pc % 64)) & 1; }
+
+    // Flip the breakpoint at pc; returns whether it is now set
+    bool toggleBreakpoint(word pc);
+
+    void addCondition(const Chip8Condition &condition) { conditions.push_back(condition); conditionHeld.push_back(false); }
+    void addWatch(const Chip8Watch &watch) { watches.push_back(watch); }
+    void clear();
+
+    // Run up to cycles instructions, stopping early on a hit or fault.
+    // Returns the number executed; stopReason says why it stopped short.
+    int run(int cycles);
+
+    // One-line description of the last stop, e.g. "WRITE 0204 AT 02a6"
+    const char * describeStop(char * buf, int size) const;
+
+private:
+    qword breakpoints[CHIP8_RAM_BYTES / 64];
+    int breakpointCount;
+    std::vector<Chip8Condition> conditions;
+    std::vector<bool> conditionHeld;        // Each condition's result at the last check
+    std::vector<Chip8Watch> watches;
+
+    // Set after a stop so the next run() executes the instruction it stopped at
+    bool resuming;
+
+    bool conditionHolds(const Chip8Condition &condition) const;
+    bool checkWatches(word first, word last, bool write);
+    bool shouldStop();
+};
+
+#endif // CHIP8DEBUG_HPP
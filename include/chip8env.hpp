@@ -0,0 +1,81 @@
+#ifndef CHIP8ENV_HPP
+#define CHIP8ENV_HPP
+
+#include "chip8.hpp"
+#include <functional>
+
+// Bit-packed frame: 8 bytes per row, pixel x of a row is bit (7 - x % 8) of byte x / 8
+#define CHIP8_ENV_FRAME_BYTES ((CHIP8_SCREEN_WIDTH * CHIP8_SCREEN_HEIGHT) / 8)
+#define CHIP8_ENV_CYCLES_PER_FRAME 10
+
+void packDisplay(const Chip8 &machine, byte * frame);
+
+// FNV-1a over a packed frame
+unsigned long hashFrame(const byte * frame);
+
+// Observation slots in a POSIX shared-memory segment, one packed frame per slot,
+// laid out back to back so a learner can map the same name and read in place.
+class Chip8SharedFrames {
+public:
+    Chip8SharedFrames();
+    ~Chip8SharedFrames();
+
+    // Create (or attach to) the segment, closing any open one first; false and
+    // errno set on failure, EINVAL when an existing segment isn't slots frames long
+    bool open(const char * name, int slots, bool create);
+    void close();
+
+    // Remove the name; mappings stay valid until closed
+    static bool unlink(const char * name);
+
+    byte * slot(int i) { return base + i * CHIP8_ENV_FRAME_BYTES; }
+    int slots() const { return slotCount; }
+
+private:
+    byte * base;
+    int slotCount;
+    int fd;
+};
+
+struct Chip8StepResult {
+    unsigned long frameHash;
+    float reward;
+    bool done;
+};
+
+// Headless stepping environment around one machine.
+// Actions are a 16-bit mask of held keys; observations are packed frames
+// written to a caller-provided buffer (e.g. a Chip8SharedFrames slot).
+class Chip8Env {
+public:
+    Chip8 machine;
+    int cyclesPerFrame;
+
+    // Optional, called after each step; a fault always ends the episode
+    std::function<float(const Chip8 &)> rewardHook;
+    std::function<bool(const Chip8 &)> doneHook;
+
+    // observation may be nullptr to use a buffer owned by the env
+    Chip8Env(const byte * rom, byte * observation = nullptr);
+
+    // Restore the freshly loaded machine and write the first observation
+    unsigned long reset();
+
+    Chip8StepResult step(word actionMask, int frameSkip);
+
+    const byte * observation() const { return frame; }
+
+    // The embedded machine is line-aligned, so heap envs must be too
+    static void * operator new(size_t size);
+    static void operator delete(void * p);
+
+private:
+    Chip8Snapshot start;
+    word heldKeys;
+    byte * frame;
+    byte ownFrame[CHIP8_ENV_FRAME_BYTES];
+
+    void applyKeys(word actionMask);
+};
+
+#endif // CHIP8ENV_HPP
@@ -0,0 +1,68 @@
+#ifndef CHIP8EXPORT_HPP
+#define CHIP8EXPORT_HPP
+
+#include "chip8.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Frames held between the emulator and the writer thread
+#define CHIP8_EXPORT_QUEUE_FRAMES 64
+
+// Largest pixel size; 64 makes 4096x2048 frames
+#define CHIP8_EXPORT_MAX_SCALE 64
+
+enum Chip8ExportFormat {
+    CHIP8_EXPORT_PBM,       // Back-to-back raw P4 images, lit pixels black
+    CHIP8_EXPORT_Y4M,       // YUV4MPEG2 mono stream, lit pixels white
+};
+
+// Writes displays as an image sequence or video stream on a writer thread.
+// frame() copies the display into a preallocated queue slot and returns;
+// the writer formats into a preallocated buffer, so neither side allocates.
+class Chip8FrameExport {
+public:
+    int every;                      // Keep every Nth frame offered
+    int scale;                      // Pixel size in the output, 1 to CHIP8_EXPORT_MAX_SCALE
+
+    unsigned long framesSeen;
+    unsigned long framesWritten;
+    unsigned long framesSkipped;    // Same display as the last kept frame
+    unsigned long stalls;           // frame() waited for the writer
+
+    Chip8FrameExport();
+    ~Chip8FrameExport();
+
+    // path "-" is stdout; false and errno set if it can't be opened
+    bool open(const char * path, Chip8ExportFormat format);
+
+    // Drain the queue and stop the writer
+    void close();
+
+    // Offer the machine's display; call where the frontend sees draw set
+    void frame(const Chip8 &machine);
+
+private:
+    FILE * out;
+    Chip8ExportFormat format;
+
+    qword last[CHIP8_SCREEN_HEIGHT];
+    bool haveLast;
+
+    qword queue[CHIP8_EXPORT_QUEUE_FRAMES][CHIP8_SCREEN_HEIGHT];
+    unsigned long head;             // Next slot frame() fills
+    unsigned long tail;             // Next slot the writer formats
+    std::vector<byte> buffer;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    bool stopping;
+    std::thread writer;
+
+    size_t encode(const qword * display);
+    void writeFrames();
+};
+
+#endif // CHIP8EXPORT_HPP
@@ -0,0 +1,60 @@
+#ifndef CHIP8LIVE_HPP
+#define CHIP8LIVE_HPP
+
+#include "chip8.hpp"
+#include <atomic>
+
+#define CHIP8_LIVE_MAGIC 0x4c533843     // "C8SL"
+#define CHIP8_LIVE_VERSION 1
+
+// Everything an inspector needs to show a machine, as plain data
+struct Chip8LiveState {
+    unsigned long frame;                // Publishes since the segment was created
+    word programCounter;
+    word indexRegister;
+    byte stackPointer;
+    byte delayTimer;
+    byte soundTimer;
+    Chip8Fault fault;
+    byte variableRegisters[CHIP8_VARIABLE_REGISTERS];
+    byte keyState[16];
+    word stack[CHIP8_STACK_HEIGHT];
+    qword displayBuffer[CHIP8_SCREEN_HEIGHT];
+};
+
+// The segment. sequence is odd while the publisher is writing state.
+struct Chip8LiveSegment {
+    unsigned int magic;
+    unsigned int version;
+    std::atomic<unsigned int> sequence;
+    Chip8LiveState state;
+};
+
+// Live machine state in a POSIX shared-memory segment, guarded by a seqlock.
+// The terminal frontend publishes after every cycle, headless runs on each
+// drawn frame and on a debugger stop. Neither waits on readers; readers
+// retry until they copy a state that wasn't being written.
+class Chip8LiveExport {
+public:
+    Chip8LiveExport();
+    ~Chip8LiveExport();
+
+    // Create the segment to publish, or attach to read; false and errno set on failure,
+    // EINVAL when the segment to attach is too short or isn't a live segment
+    bool open(const char * name, bool create);
+    void close();
+
+    // Remove the name; mappings stay valid until closed
+    static bool unlink(const char * name);
+
+    void publish(const Chip8 &machine);
+
+    // Copy out a consistent state; false if the segment isn't a live export
+    bool read(Chip8LiveState &out) const;
+
+private:
+    Chip8LiveSegment * segment;
+    int fd;
+};
+
+#endif // CHIP8LIVE_HPP
@@ -0,0 +1,35 @@
+#ifndef CHIP8POOL_HPP
+#define CHIP8POOL_HPP
+
+#include "chip8.hpp"
+#include <cstddef>
+#include <ostream>
+
+// Many machines in one line-aligned arena, for hosts that keep thousands alive.
+// The block is mapped once (transparent huge pages where the kernel allows)
+// and the machines sit back to back, so walking the pool is a linear scan.
+class Chip8Pool {
+public:
+    Chip8Pool(int count);
+    ~Chip8Pool();
+
+    Chip8 & operator[](int i) { return machines[i]; }
+    int size() const { return machineCount; }
+    size_t bytes() const { return mappedBytes; }
+
+    // Restore every machine to snap; RAM pages already matching it are skipped
+    void resetAll(const Chip8Snapshot &snap);
+
+private:
+    Chip8Pool(const Chip8Pool &) = delete;
+    Chip8Pool & operator=(const Chip8Pool &) = delete;
+
+    Chip8 * machines;
+    int machineCount;
+    size_t mappedBytes;
+};
+
+// sizeof/offsetof summary and instances per GiB for each way of hosting machines
+void printLayoutReport(std::ostream &out);
+
+#endif // CHIP8POOL_HPP
@@ -0,0 +1,118 @@
+#ifndef CHIP8ROM_HPP
+#define CHIP8ROM_HPP
+
+#include "chip8.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define CHIP8_ANALYSIS_MAGIC "C8AN"
+#define CHIP8_ANALYSIS_VERSION 1
+
+// A ROM file mapped read-only. The mapping is one page, so data() always has
+// CHIP8_ROM_BYTES readable bytes: the kernel zero-fills past the end of file.
+class Chip8Rom {
+public:
+    Chip8Rom();
+    ~Chip8Rom();
+
+    // False and errno set if the file can't be mapped (empty files included)
+    bool open(const char * path);
+    void close();
+
+    const byte * data() const { return mapped; }
+    int size() const { return fileBytes; }
+
+    // FNV-1a over the file's bytes; names the analysis cache entry
+    unsigned long hash() const { return contentHash; }
+
+private:
+    byte * mapped;
+    int fileBytes;
+    unsigned long contentHash;
+};
+
+enum Chip8BlockExit : byte {
+    CHIP8_EXIT_FALLTHROUGH = 0,     // Next instruction starts another block
+    CHIP8_EXIT_JUMP,                // 1NNN
+    CHIP8_EXIT_CALL,                // 2NNN, returning to the next instruction
+    CHIP8_EXIT_RETURN,              // 00EE
+    CHIP8_EXIT_SKIP,                // 3XNN 4XNN 5XY0 9XY0 EX9E EXA1
+    CHIP8_EXIT_BAD,                 // BNNN (faults in this core), or runs off the end of RAM
+};
+
+// Quirk-sensitive instructions present in reachable code
+enum Chip8QuirkUse {
+    CHIP8_QUIRK_SHIFT       = 1 << 0,   // 8XY6/8XYE with X != Y: copyBeforeShifting matters
+    CHIP8_QUIRK_LOAD_STORE  = 1 << 1,   // FX55/FX65: whether I advances differs by interpreter
+    CHIP8_QUIRK_LOGIC_VF    = 1 << 2,   // 8XY1/2/3: whether VF is reset
+    CHIP8_QUIRK_SELF_WRITE  = 1 << 3,   // FX33/FX55, with some ANNN pointing into code
+};
+
+enum Chip8IdleKind : byte {
+    CHIP8_IDLE_SPIN = 0,            // 1NNN to itself
+    CHIP8_IDLE_DELAY,               // FX07, 3X00, 1NNN back: waits for DT
+    CHIP8_IDLE_KEY,                 // FX0A
+};
+
+struct Chip8BasicBlock {
+    word start;
+    word end;                       // Address after the last instruction
+    Chip8BlockExit exit;
+};
+
+// A reachable instruction with its operands split out
+struct Chip8Decoded {
+    word address;
+    word opcode;
+    byte X;
+    byte Y;
+    byte N;
+    byte NN;
+    word NNN;
+};
+
+struct Chip8IdleSite {
+    word address;
+    Chip8IdleKind kind;
+};
+
+// Static analysis of a ROM, found by walking control flow from 0x200.
+// Results are cached on disk by content hash, so a ROM is analysed once.
+class Chip8RomAnalysis {
+public:
+    unsigned long hash;
+    std::vector<Chip8BasicBlock> blocks;
+    std::vector<Chip8Decoded> instructions;
+    std::vector<Chip8IdleSite> idleSites;
+    unsigned int quirks;
+
+    Chip8RomAnalysis();
+
+    void analyze(const Chip8Rom &rom);
+
+    // Read or write one cache entry; load fails on any mismatch or out-of-range field
+    bool load(const std::string &path, unsigned long expectHash);
+    bool save(const std::string &path) const;
+
+    // Cached result if there is one, else analyze and store it.
+    // Returns true on a cache hit. An empty dir uses defaultCacheDir().
+    bool loadOrAnalyze(const Chip8Rom &rom, std::string dir = "");
+
+    // $CHIP8_CACHE_DIR, else $XDG_CACHE_HOME/cursechip, else ~/.cache/cursechip
+    static std::string defaultCacheDir();
+
+    // A 1NNN-to-itself at pc in the ROM as loaded, i.e. nothing but a timer or key
+    // can change anything; self-modifying code can have replaced it since
+    bool spinsAt(word pc) const { return (spinSites[pc / 64 % (CHIP8_RAM_BYTES / 64)] >> (pc % 64)) & 1; }
+
+    void print(FILE * out) const;
+
+private:
+    qword spinSites[CHIP8_RAM_BYTES / 64];
+
+    void indexSites();
+    bool consistent() const;
+};
+
+#endif // CHIP8ROM_HPP
@@ -0,0 +1,84 @@
+#ifndef CHIP8STREAM_HPP
+#define CHIP8STREAM_HPP
+
+#include "chip8.hpp"
+#include <string>
+#include <vector>
+
+// Connection: the server sends magic and a version byte, then messages of
+// [type byte][payload length u16][payload], little-endian. Rows are 8 bytes,
+// most significant first, so the first byte's top bit is pixel (0, y).
+#define CHIP8_STREAM_MAGIC          "C8ST"
+#define CHIP8_STREAM_VERSION        1
+
+#define CHIP8_STREAM_KEYFRAME       1   // Frame number u32, then every row
+#define CHIP8_STREAM_DELTA          2   // Frame number u32, changed-row mask u32, then those rows
+
+#define CHIP8_STREAM_HEADER_BYTES   3
+#define CHIP8_STREAM_MAX_MESSAGE    (CHIP8_STREAM_HEADER_BYTES + 8 + 8 * CHIP8_SCREEN_HEIGHT)
+
+// Viewers send one byte per key event: the key in the low nibble, bit 7 set when pressed
+#define CHIP8_STREAM_KEY_DOWN       0x80
+
+#define CHIP8_STREAM_MAX_VIEWERS    32
+#define CHIP8_STREAM_DROP_FRAMES    120 // A viewer this many frames behind is disconnected
+
+struct Chip8StreamKey {
+    byte key;
+    bool down;
+};
+
+// Broadcasts the display to local viewers over a Unix socket. Each frame is
+// encoded once, as the rows that changed, whatever the number of viewers.
+// Sockets are non-blocking: a viewer that hasn't taken the last frame skips
+// frames and gets a keyframe once it catches up, and is dropped if it doesn't.
+class Chip8StreamServer {
+public:
+    unsigned long frames;           // Frames encoded
+    unsigned long skipped;          // Frames not sent to a viewer that was behind
+    unsigned long dropped;          // Viewers disconnected for falling behind
+
+    Chip8StreamServer();
+    ~Chip8StreamServer();
+
+    // Listen at path, replacing only a socket nobody answers on; the socket is
+    // owner-only (0600). False and errno set on failure, EADDRINUSE for a live
+    // server or any other file there
+    bool open(const char * path);
+
+    // Disconnect everyone and remove the socket
+    void close();
+
+    int viewerCount() const { return viewers.size(); }
+
+    // Accept viewers, finish pending sends and collect key events, up to max.
+    // Never blocks.
+    int poll(Chip8StreamKey * keys, int max);
+
+    // A viewer could take a keyframe now; lets a new viewer see a screen that isn't changing
+    bool waiting() const;
+
+    // Encode the display against the last frame and send it to every viewer
+    void frame(const Chip8 &machine);
+
+private:
+    struct Viewer {
+        int fd;
+        std::vector<byte> pending;  // Queued bytes not yet taken by the socket
+        size_t sent;
+        bool needKeyframe;
+        int behind;                 // Frames skipped in a row
+    };
+
+    int listener;
+    std::string path;
+    std::vector<Viewer> viewers;
+    qword previous[CHIP8_SCREEN_HEIGHT];
+    std::vector<byte> delta;
+    std::vector<byte> keyframe;
+
+    bool flush(Viewer &viewer);
+    void disconnect(size_t index);
+};
+
+#endif // CHIP8STREAM_HPP
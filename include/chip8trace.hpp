@@ -0,0 +1,124 @@
+#ifndef CHIP8TRACE_HPP
+#define CHIP8TRACE_HPP
+
+#include "chip8.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// File: magic, version byte, then blocks of
+// [raw length u32][stored length u32][method byte][stored bytes], little-endian.
+// Every block opens with a SYNC record, so each decodes on its own.
+#define CHIP8_TRACE_MAGIC           "C8TR"
+#define CHIP8_TRACE_VERSION         1
+#define CHIP8_TRACE_BLOCK_BYTES     (256 * 1024)
+#define CHIP8_TRACE_QUEUE_BLOCKS    8
+
+// Largest encoded record, with room to spare
+#define CHIP8_TRACE_MAX_RECORD      64
+
+#define CHIP8_TRACE_STORED          0
+#define CHIP8_TRACE_ZLIB            1
+
+// Record layout: flags byte, then the big-endian opcode (except SYNC),
+// then each field below whose flag is set, in this order.
+enum Chip8TraceFlag : byte {
+    CHIP8_TRACE_JUMP        = 1 << 0,   // PC isn't the last PC + 2: zigzag varint delta from it
+    CHIP8_TRACE_INDEX       = 1 << 1,   // I changed: zigzag varint delta
+    CHIP8_TRACE_REGISTERS   = 1 << 2,   // Varint mask of changed V registers, then their values
+    CHIP8_TRACE_STACK       = 1 << 3,   // New SP
+    CHIP8_TRACE_TIMERS      = 1 << 4,   // DT and ST, when set rather than counted down
+    CHIP8_TRACE_WRITE       = 1 << 5,   // Varint address, length byte, the bytes written
+    CHIP8_TRACE_FAULT       = 1 << 6,   // Chip8Fault byte
+    CHIP8_TRACE_SYNC        = 1 << 7,   // Alone: PC, I (words), V0-VF, SP, DT, ST
+};
+
+// One executed instruction, with the machine state after it
+struct Chip8TraceRecord {
+    unsigned long index;            // Instructions since the trace started
+    byte flags;
+    word programCounter;            // Where the opcode was fetched
+    word opcode;
+    word indexRegister;
+    byte variableRegisters[CHIP8_VARIABLE_REGISTERS];
+    word changedRegisters;          // Bit X set when VX changed
+    byte stackPointer;
+    byte delayTimer;
+    byte soundTimer;
+    word writeAddress;
+    byte writeLength;
+    byte written[CHIP8_VARIABLE_REGISTERS];
+    Chip8Fault fault;
+};
+
+// Runs a machine while recording every instruction to a trace file.
+// Encoding happens inline; a writer thread compresses and writes full
+// blocks, and step() only waits if the writer falls a whole queue behind.
+class Chip8Tracer {
+public:
+    Chip8 &machine;
+
+    unsigned long records;
+    unsigned long stalls;           // Blocks handed over with the queue full
+
+    Chip8Tracer(Chip8 &machine);
+    ~Chip8Tracer();
+
+    // False and errno set if the file can't be created
+    bool open(const char * path);
+
+    // Write out the last block and stop the writer
+    void close();
+
+    // One Chip8::cycle(), recorded
+    void step();
+    void run(int cycles);
+
+private:
+    FILE * out;
+    std::vector<byte> block;
+    word lastPc;
+    bool needSync;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<byte>> queue;
+    std::vector<std::vector<byte>> spare;
+    bool stopping;
+    std::thread writer;
+
+    void writeSync();
+    void submitBlock();
+    void writeBlocks();
+};
+
+// Reads a trace back one instruction at a time
+class Chip8TraceReader {
+public:
+    bool damaged;                   // next() stopped on corrupt data, not at the end
+
+    Chip8TraceReader();
+    ~Chip8TraceReader();
+
+    // False on a missing file or a bad header
+    bool open(const char * path);
+    void close();
+
+    // False at the end of the trace, or with damaged set on a corrupt block or record
+    bool next(Chip8TraceRecord &record);
+
+private:
+    FILE * in;
+    std::vector<byte> raw;
+    std::vector<byte> stored;
+    size_t pos;
+    Chip8TraceRecord state;
+
+    bool readBlock();
+    bool corrupt();
+};
+
+#endif // CHIP8TRACE_HPP
@@ -1,8 +1,111 @@
 #ifndef FRONTEND_HPP
 #define FRONTEND_HPP
 
-class CursesFrontend {
-public:
+#include "chip8.hpp"
+#include "chip8debug.hpp"
+#include "chip8export.hpp"
+#include "chip8live.hpp"
+#include "chip8rom.hpp"
+#include "chip8stream.hpp"
+#include "chip8trace.hpp"
+#include "metrics.hpp"
+#include "ncurses.h"
+#include <string>
+#include <ctime>
+
+// Window sizes, and positions relative to an instance's origin
+
+#define FRONTEND_SCREEN_WIDTH       ((CHIP8_SCREEN_WIDTH))
+#define FRONTEND_SCREEN_HEIGHT      ((CHIP8_SCREEN_HEIGHT / 2))
+#define FRONTEND_SCREEN_X           0
+#define FRONTEND_SCREEN_Y           0
+
+#define FRONTEND_SIDEBAR_HEIGHT     (FRONTEND_SCREEN_HEIGHT)
+#define FRONTEND_SIDEBAR_WIDTH      18
+#define FRONTEND_SIDEBAR_X          (FRONTEND_SCREEN_WIDTH + 2)
+#define FRONTEND_SIDEBAR_Y          0
+
+#define FRONTEND_HELPBAR_HEIGHT     1
+#define FRONTEND_HELPBAR_WIDTH      (FRONTEND_SCREEN_WIDTH + FRONTEND_SIDEBAR_WIDTH)
+#define FRONTEND_HELPBAR_X          0
+#define FRONTEND_HELPBAR_Y          (FRONTEND_SCREEN_HEIGHT + 2)
+
+#define FRONTEND_METRICS_WIDTH      (FRONTEND_HELPBAR_WIDTH + 4)
+#define FRONTEND_METRICS_X          0
+#define FRONTEND_METRICS_Y          (FRONTEND_HELPBAR_Y + FRONTEND_HELPBAR_HEIGHT + 2)
+
+// One tile per instance: display and sidebar side by side, boxes included
+#define FRONTEND_TILE_WIDTH         (FRONTEND_SCREEN_WIDTH + 2 + FRONTEND_SIDEBAR_WIDTH + 2)
+#define FRONTEND_TILE_HEIGHT        (FRONTEND_SCREEN_HEIGHT + 2)
+#define FRONTEND_TILE_FRAMERATE     60
+#define FRONTEND_TILE_CYCLES        10      // Per frame per instance
+#define FRONTEND_TILE_KEY_FRAMES    6       // A key press stays down this long
+
+#define FRONTEND_VIEWER_KEYS        64      // Key events taken from viewers per cycle
+
+#define FRONTEND_STATUS_X           60
+#define FRONTEND_STATUS_WIDTH       24
+
+#define FRONTEND_PIX_TOP            "▀"
+#define FRONTEND_PIX_BTM            "▄"
+#define FRONTEND_PIX_BOTH           "█"
+
+#define FRONTEND_HOT_ROWS           5
+#define FRONTEND_HOT_INTERVAL       256
+
+#define NS_IN_SECOND                1000000000
+#define CURSE_CHIP_FRAMERATE        20
+
+
+// Screen positions of one instance's windows
+struct frontend_layout {
+    int screen_x, screen_y;
+    int sidebar_x, sidebar_y;
+    int helpbar_x, helpbar_y;
+    int metrics_x, metrics_y;
 };
 
+struct chip_frontend {
+    Chip8 * sys;
+    frontend_layout layout;
+    Chip8Debugger * debugger;
+    Chip8Tracer * tracer;           // Null unless tracing
+    Chip8LiveExport * live;         // Null unless publishing
+    Chip8FrameExport * exporter;    // Null unless exporting frames
+    Chip8RomAnalysis * analysis;    // Null if the ROM wasn't analysed
+    Chip8StreamServer * server;     // Null unless serving viewers
+    WINDOW * display_win;
+    WINDOW * sidebar_win;
+    WINDOW * helpbar_win;
+    bool paused;
+    int key_time_left[16];
+    frontend_metrics metrics;
+};
+
+void init_curses();
+frontend_layout instance_layout(int index, int columns, int rows);
+WINDOW * create_window(int x, int y, int w, int h);
+void draw_display_row(WINDOW * display, const Chip8 &sys, int row);
+void draw_display(struct chip_frontend * fe);
+void setup_instance_windows(struct chip_frontend * fe);
+void setup_windows(struct chip_frontend * fe);
+void write_starting_info(chip_frontend &fe);
+void write_debug_text(chip_frontend &fe);
+void write_debug_info(chip_frontend &fe);
+#ifdef CHIP8_PROFILE
+void write_hot_addresses(chip_frontend &fe);
+#endif
+void write_status(chip_frontend &fe, const char * status);
+bool parse_break_spec(Chip8Debugger &debugger, const std::string &spec);
+bool parse_watch_spec(Chip8Debugger &debugger, const std::string &spec);
+void press_key(chip_frontend &fe, int key, bool down);
+void poll_viewers(chip_frontend &fe);
+void cycle_machine(chip_frontend &fe);
+void run_cycle(chip_frontend &fe, timespec &last_frame, timespec &now);
+int run_headless(chip_frontend &fe, long cycles);
+int map_to_keypad(char inputc);
+char handle_input(chip_frontend &fe);
+void open_rom(Chip8Rom &rom, const std::string &filename);
+timespec timespec_sub(timespec start, timespec end);
+
 #endif
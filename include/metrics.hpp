@@ -0,0 +1,59 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "ncurses.h"
+#include <cstdio>
+
+// Log-linear buckets: 8 per power of two, so percentiles are within 12.5%
+#define METRICS_SUB_BUCKETS         8
+#define METRICS_HIST_BUCKETS        (64 * METRICS_SUB_BUCKETS)
+
+#define METRICS_CSV_HEADER          "frame,frame_ns,draw_ns,debug_ns,bytes,input_latency_ns"
+#define METRICS_CSV_HEADER_PROCESS  "frame,frame_ns,draw_ns,debug_ns,process_bytes,input_latency_ns"
+
+struct duration_histogram {
+    unsigned long counts[METRICS_HIST_BUCKETS];
+    unsigned long total;
+};
+
+void histogram_add(duration_histogram &h, long ns);
+long histogram_percentile(const duration_histogram &h, double p);
+
+// Frontend timing and terminal bandwidth, gathered per presented frame
+struct frontend_metrics {
+    bool overlay;
+    FILE * csv;
+    WINDOW * overlay_win;
+
+    FILE * proc_io;                     // /proc/self/io, opened on the first frame
+    bool process_bytes;                 // Trace, export or socket writes share the count with the terminal
+
+    unsigned long frames;
+    unsigned long total_bytes;
+    unsigned long frame_start_bytes;    // Process write count after the last frame, 0 before it
+    unsigned long last_frame_bytes;
+
+    long last_frame_ns;                 // 0 until the first frame
+    long key_ns;                        // Oldest key event not yet on screen, 0 if none
+    long frame_debug_ns;                // write_debug_info time since the last frame
+
+    duration_histogram frame_time;
+    duration_histogram draw_time;
+    duration_histogram debug_time;
+    duration_histogram input_latency;
+};
+
+long now_ns();
+
+// Bytes this process has passed to write(). ncurses writes the terminal
+// straight through its file descriptor, so this is the only place it shows;
+// it is terminal bandwidth only while nothing else writes.
+unsigned long process_bytes_written(frontend_metrics &m);
+
+bool metrics_enabled(const frontend_metrics &m);
+void metrics_key_event(frontend_metrics &m);
+void metrics_frame(frontend_metrics &m, long draw_ns);
+void toggle_metrics_overlay(frontend_metrics &m, int x, int y, int w);
+void write_metrics_overlay(frontend_metrics &m);
+
+#endif
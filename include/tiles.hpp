@@ -0,0 +1,26 @@
+#ifndef TILES_HPP
+#define TILES_HPP
+
+#include "frontend.hpp"
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One ROM in the tiled view. Its core thread runs fe.sys under lock; the
+// renderer copies the machine out under the same lock and draws the copy,
+// so terminal output never holds up emulation.
+struct tile_instance {
+    chip_frontend fe;
+    std::string name;
+    std::mutex lock;
+    std::thread core;
+    qword shown[CHIP8_SCREEN_HEIGHT];       // Display rows on screen, for dirty-row redraws
+    bool drawn;                             // shown is valid
+    std::string title;                      // Title on screen
+};
+
+// Run every ROM side by side until Esc; returns the exit status
+int run_tiled(const std::vector<std::string> &roms);
+
+#endif
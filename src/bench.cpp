@@ -0,0 +1,296 @@
+#include "chip8.hpp"
+#include "chip8batch.hpp"
+#include "chip8env.hpp"
+#include "frontend.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <locale.h>
+#include <string>
+#include <vector>
+
+#define BENCH_MACRO_FRAMES      100000
+#define BENCH_BATCH_LANES       256
+#define BENCH_BATCH_FRAMES      2000
+
+// Small programs written for this suite and placed in the public domain
+
+// Clear, BCD a counter and draw its three digits every frame
+static const byte romDigits[] = {
+    0x00, 0xE0, 0xA3, 0x00, 0xF5, 0x33, 0xF2, 0x65,
+    0x6A, 0x10, 0x6B, 0x08, 0xF0, 0x29, 0xDA, 0xB5,
+    0x7A, 0x06, 0xF1, 0x29, 0xDA, 0xB5, 0x7A, 0x06,
+    0xF2, 0x29, 0xDA, 0xB5, 0x75, 0x01, 0x12, 0x00,
+};
+
+// Register arithmetic in a tight loop
+static const byte romAlu[] = {
+    0x60, 0x01, 0x61, 0x02, 0x62, 0x03, 0x80, 0x14,
+    0x81, 0x25, 0x82, 0x36, 0x83, 0x07, 0x84, 0x0E,
+    0x85, 0x11, 0x86, 0x22, 0x87, 0x33, 0x70, 0x01,
+    0x30, 0x00, 0x12, 0x06, 0x12, 0x00,
+};
+
+// An 8x8 sprite drawn, erased and moved by a subroutine
+static const byte romBounce[] = {
+    0x60, 0x00, 0x61, 0x00, 0x62, 0x01, 0x63, 0x01,
+    0xA2, 0x40, 0xD0, 0x18, 0xD0, 0x18, 0x22, 0x30,
+    0x12, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x80, 0x24, 0x81, 0x34, 0x00, 0xEE, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF,
+};
+
+struct bench_result {
+    std::string group;
+    std::string name;
+    double value;
+    std::string unit;
+};
+
+static std::vector<bench_result> results;
+static volatile unsigned long sink;
+
+template <typename F>
+double ns_per_iteration(long iterations, F body) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        body();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void record(const std::string &group, const std::string &name, double value, const std::string &unit) {
+    bench_result r = { group, name, value, unit };
+    results.push_back(r);
+    fprintf(stderr, "%-8s %-28s %12.2f %s\n", group.c_str(), name.c_str(), value, unit.c_str());
+}
+
+// A program zero-padded to a full ROM
+std::vector<byte> rom_image(const byte * program, size_t size) {
+    std::vector<byte> rom(CHIP8_ROM_BYTES);
+    memcpy(rom.data(), program, size);
+    return rom;
+}
+
+// A JSON string literal, quotes included
+std::string json_string(const std::string &text) {
+    std::string out = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void bench_execute(long iterations) {
+    struct { const char * name; word opcode; } classes[] = {
+        { "1NNN jump",          0x1200 },
+        { "3XNN skip",          0x3A00 },
+        { "6XNN set",           0x6A12 },
+        { "7XNN add",           0x7A01 },
+        { "8XY4 add carry",     0x8AB4 },
+        { "8XYE shift",         0x8ABE },
+        { "ANNN set index",     0xA300 },
+        { "CXNN random",        0xCAFF },
+        { "EX9E key",           0xE09E },
+        { "FX1E add index",     0xFA1E },
+        { "FX33 bcd",           0xFA33 },
+        { "FX55 store",         0xFF55 },
+        { "FX65 load",          0xFF65 },
+    };
+
+    Chip8 m;
+    for (size_t c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+        word opcode = classes[c].opcode;
+        m.reset();
+
+        double ns = ns_per_iteration(iterations, [&]() {
+            m.indexRegister = 0x300;
+            m.execute(opcode);
+        });
+        sink += m.variableRegisters[0xA];
+        record("execute", classes[c].name, ns, "ns/op");
+    }
+
+    m.reset();
+    double ns = ns_per_iteration(iterations, [&]() {
+        m.execute(0x2300);
+        m.execute(0x00EE);
+    });
+    record("execute", "2NNN+00EE call/return", ns / 2, "ns/op");
+}
+
+void bench_draw(long iterations) {
+    struct { const char * name; byte x, y, n; } cases[] = {
+        { "DXYN h1 aligned",        0,  0,  1 },
+        { "DXYN h5 aligned",        8,  8,  5 },
+        { "DXYN h15 aligned",       16, 8,  15 },
+        { "DXYN h15 unaligned",     19, 3,  15 },
+        { "DXYN h15 clip right",    60, 4,  15 },
+        { "DXYN h15 clip bottom",   20, 28, 15 },
+    };
+
+    Chip8 m;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        m.reset();
+        m.indexRegister = 0x050;
+        m.variableRegisters[0] = cases[c].x;
+        m.variableRegisters[1] = cases[c].y;
+        byte n = cases[c].n;
+
+        double ns = ns_per_iteration(iterations, [&]() { m.opDraw(0, 1, n); });
+        sink += m.displayBuffer[cases[c].y];
+        record("draw", cases[c].name, ns, "ns/op");
+    }
+
+    double ns = ns_per_iteration(iterations, [&]() { m.opClear(); });
+    record("draw", "00E0 clear", ns, "ns/op");
+}
+
+void bench_reset(long iterations) {
+    Chip8 m;
+    std::vector<byte> rom = rom_image(romDigits, sizeof(romDigits));
+
+    double ns = ns_per_iteration(iterations, [&]() { m.reset(); });
+    record("reset", "reset", ns, "ns/op");
+
+    ns = ns_per_iteration(iterations, [&]() { m.reset(); m.load(rom.data()); });
+    record("reset", "reset + load", ns, "ns/op");
+
+    m.load(rom.data());
+    Chip8Snapshot snap = m.snapshot();
+    ns = ns_per_iteration(iterations, [&]() { m.cycle(); m.resetTo(snap); });
+    record("reset", "cycle + resetTo", ns, "ns/op");
+    sink += m.programCounter;
+}
+
+// Full-window redraws into ncurses writing to /dev/null
+void bench_draw_display(long iterations) {
+    FILE * nullOut = fopen("/dev/null", "w");
+    FILE * nullIn = fopen("/dev/null", "r");
+    const char * term = getenv("TERM") ? getenv("TERM") : "xterm";
+
+    setenv("COLUMNS", "120", 1);
+    setenv("LINES", "40", 1);
+    setlocale(LC_ALL, "");
+
+    SCREEN * screen = newterm(term, nullOut, nullIn);
+    if (!screen) {
+        fprintf(stderr, "draw_display skipped: no terminfo for %s\n", term);
+        return;
+    }
+    set_term(screen);
+
+    Chip8 a, b;
+    std::vector<byte> rom = rom_image(romBounce, sizeof(romBounce));
+    a.load(rom.data());
+    for (int i = 0; i < 500; i++) a.cycle();
+    b = a.clone();
+    for (int i = 0; i < 37; i++) b.cycle();
+
+    struct chip_frontend fe = {};
+    memset(&fe, 0, sizeof(fe));
+    setup_windows(&fe);
+
+    long frame = 0;
+    double ns = ns_per_iteration(iterations, [&]() {
+        fe.sys = (frame++ & 1) ? &a : &b;
+        draw_display(&fe);
+    });
+    record("frontend", "draw_display", ns, "ns/frame");
+
+    endwin();
+    delscreen(screen);
+    fclose(nullOut);
+    fclose(nullIn);
+}
+
+void bench_rom(const std::string &name, const byte * rom, long frames) {
+    Chip8 m;
+    m.load(rom);
+    long cycles = frames * CHIP8_ENV_CYCLES_PER_FRAME;
+
+    double ns = ns_per_iteration(cycles, [&]() { m.cycle(); });
+    if (m.fault) {
+        fprintf(stderr, "%s stopped early: %s\n", name.c_str(), faultName(m.fault));
+    }
+    record("rom", name, 1000.0 / ns, "MIPS");
+
+    Chip8Batch batch(BENCH_BATCH_LANES);
+    batch.load(rom);
+    long batchCycles = BENCH_BATCH_FRAMES * CHIP8_ENV_CYCLES_PER_FRAME;
+    ns = ns_per_iteration(batchCycles, [&]() { batch.step(); });
+    record("batch", name, 1000.0 * BENCH_BATCH_LANES / ns, "MIPS");
+}
+
+void write_json(FILE * out) {
+    fprintf(out, "{\n  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        fprintf(out, "    {\"group\": %s, \"name\": %s, \"value\": %.3f, \"unit\": %s}%s\n",
+            json_string(results[i].group).c_str(), json_string(results[i].name).c_str(), results[i].value,
+            json_string(results[i].unit).c_str(), i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char ** argv)
+{
+    std::string jsonFile;
+    std::vector<std::string> romFiles;
+    long scale = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--json" && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else if (arg == "--quick") {
+            scale = 20;
+        } else {
+            romFiles.push_back(arg);
+        }
+    }
+
+    bench_execute(10000000 / scale);
+    bench_draw(2000000 / scale);
+    bench_reset(1000000 / scale);
+    bench_draw_display(20000 / scale);
+
+    bench_rom("digits", rom_image(romDigits, sizeof(romDigits)).data(), BENCH_MACRO_FRAMES / scale);
+    bench_rom("alu", rom_image(romAlu, sizeof(romAlu)).data(), BENCH_MACRO_FRAMES / scale);
+    bench_rom("bounce", rom_image(romBounce, sizeof(romBounce)).data(), BENCH_MACRO_FRAMES / scale);
+    for (size_t i = 0; i < romFiles.size(); i++) {
+        Chip8Rom rom;
+        open_rom(rom, romFiles[i]);
+        bench_rom(romFiles[i], rom.data(), BENCH_MACRO_FRAMES / scale);
+    }
+
+    if (jsonFile.empty()) {
+        write_json(stdout);
+    } else {
+        FILE * out = fopen(jsonFile.c_str(), "w");
+        if (!out) {
+            perror(jsonFile.c_str());
+            return 1;
+        }
+        write_json(out);
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -1,7 +1,45 @@
 #include "chip8.hpp"
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <new>
+#include <algorithm>
+
+const byte chip8Font[CHIP8_FONT_BYTES] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+const char * faultName(Chip8Fault fault) {
+    switch (fault) {
+        case CHIP8_FAULT_NONE:              return "none";
+        case CHIP8_FAULT_BAD_OPCODE:        return "unsupported instruction";
+        case CHIP8_FAULT_STACK_OVERFLOW:    return "stack overflow";
+        case CHIP8_FAULT_STACK_UNDERFLOW:   return "stack underflow";
+        case CHIP8_FAULT_RAM_RANGE:         return "RAM access out of range";
+        case CHIP8_FAULT_BAD_KEY:           return "key out of range";
+    }
+    return "unknown";
+}
 
 word combine(byte leftByte, byte rightByte) {
     return ((leftByte << 8) | rightByte);
@@ -17,6 +55,23 @@ Chip8::Chip8() {
     reset();    
 }
 
+void * Chip8::operator new(size_t size) {
+    void * p = nullptr;
+    if (posix_memalign(&p, alignof(Chip8), size) != 0) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void Chip8::operator delete(void * p) {
+    free(p);
+}
+
+// Everything a cycle touches outside RAM, the display and the stack sits in the
+// first line, and the stack fits in the second
+static_assert(offsetof(Chip8, dirtyPages) + sizeof(Chip8::dirtyPages) <= 64, "Chip8 hot state spills past one cache line");
+static_assert(offsetof(Chip8, stack) == 64 && sizeof(Chip8::stack) <= 64, "Chip8 stack doesn't sit in the second cache line");
+
 void Chip8::execute(word opcode) {
 
     byte X = (opcode & 0x0F00) >> 8;    // nib 2
@@ -42,8 +97,7 @@ void Chip8::execute(word opcode) {
         case 0xE000:    executeKeyInstruction(opcode, X);           break;
         case 0xF000:    executeMiscInstruction(opcode, X);          break;
         default:
-            std::cerr << "Unsupported instruction: " << std::hex << opcode << std::endl;
-            exit(1);
+            fault = CHIP8_FAULT_BAD_OPCODE;
             break;
     }
 }
@@ -94,11 +148,7 @@ void Chip8::executeLogicMathInstruction(word opcode, byte X, byte Y) {
 }
 
 void Chip8::opClear() {
-    for (int y = 0; y < CHIP8_SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < CHIP8_SCREEN_WIDTH; x++) {
-            displayBuffer[y][x] = 0x00;
-        }
-    }
+    memset(displayBuffer, 0, sizeof(displayBuffer));
 }
 
 void Chip8::opJump(word NNN) {
@@ -123,56 +173,51 @@ void Chip8::opSetIndex(word NNN)
 void Chip8::opDraw(byte X, byte Y, byte N)
 {
     byte xCoord = variableRegisters[X] % CHIP8_SCREEN_WIDTH;
-    byte startX = xCoord;
     byte yCoord = variableRegisters[Y] % CHIP8_SCREEN_HEIGHT;
 
     // Turn off draw flag
     draw = false;
 
+#ifdef CHIP8_PROFILE
+    profile.draws++;
+#endif
+
     // Turn off VF
     variableRegisters[0xF] = 0;
 
-    // Draw bytes I up to I+N 8px wide
-    for (int y = 0; y < N; y++) {
-        // Get the row of the sprite
-        byte spriteRow = ram[indexRegister + y];
-        
-        // For bits in the byte, from MSB to LSB
-        for (int x = 7; x >= 0; x--) {
-            bool spriteBitSet = (spriteRow >> x) & 1;
-            bool bufferBitSet = (displayBuffer[yCoord][xCoord] & 1);
-
-
-            if (spriteBitSet && bufferBitSet) {
-                displayBuffer[yCoord][xCoord] = 0x00;
-                variableRegisters[0x0F] = 1;
-                draw = true;
-            } else if (spriteBitSet) {
-                displayBuffer[yCoord][xCoord] = 0x01;
-                draw = true;
-            }
+    if (!checkRange(indexRegister, N)) {
+        return;
+    }
 
-            xCoord++;
-    
-            if (xCoord >= CHIP8_SCREEN_WIDTH) {
-                break;
-            }
-        }
-        xCoord = startX;
-        yCoord++;
+    // XOR bytes I up to I+N into the rows, clipped at the right and bottom edges
+    for (int y = 0; y < N && yCoord + y < CHIP8_SCREEN_HEIGHT; y++) {
+        qword sprite = spriteMask(ram[indexRegister + y], xCoord);
+        qword &row = displayBuffer[yCoord + y];
 
-        if (yCoord >= CHIP8_SCREEN_HEIGHT) {
-            break;
+        if (row & sprite) {
+            variableRegisters[0xF] = 1;
+        }
+        if (sprite) {
+            draw = true;
         }
+        row ^= sprite;
     }
 }
 
 void Chip8::opCall(word NNN) {
+    if (stackPointer >= CHIP8_STACK_HEIGHT) {
+        fault = CHIP8_FAULT_STACK_OVERFLOW;
+        return;
+    }
     stack[stackPointer++] = programCounter;
 	programCounter = NNN;
 }
 
 void Chip8::opReturn() {
+    if (stackPointer == 0) {
+        fault = CHIP8_FAULT_STACK_UNDERFLOW;
+        return;
+    }
     programCounter = stack[--stackPointer];
 }
 
@@ -267,22 +312,26 @@ void Chip8::opRandom(byte X, byte NN) {
 }
 
 void Chip8::opSkipKeyDown(byte X) {
+    if (variableRegisters[X] > 0xF) {
+        fault = CHIP8_FAULT_BAD_KEY;
+        return;
+    }
+
     byte state = keyState[variableRegisters[X]];
-    
-    if (state > 0xF)
-        exit(1);
-    
+
     if (state == 1) {
         programCounter += 2;
     }
 }
 
 void Chip8::opSkipKeyNotDown(byte X) {
+    if (variableRegisters[X] > 0xF) {
+        fault = CHIP8_FAULT_BAD_KEY;
+        return;
+    }
+
     byte state = keyState[variableRegisters[X]];
-    
-    if (state > 0xF)
-        exit(1);
-    
+
     if (state == 0) {
         programCounter += 2;
     }
@@ -323,6 +372,10 @@ void Chip8::opGetKey(byte X) {
 
     // No key yet: If no key is pressed, decrement PC
     programCounter -= 2;
+
+#ifdef CHIP8_PROFILE
+    profile.keyWaitCycles++;
+#endif
 }
 
 void Chip8::opFontChar(byte X) {
@@ -330,26 +383,48 @@ void Chip8::opFontChar(byte X) {
 }
 
 void Chip8::opBinaryCodedDecimal(byte X) {
+    if (!checkRange(indexRegister, 3)) {
+        return;
+    }
+    markDirty(indexRegister, 3);
     ram[indexRegister] = variableRegisters[X] / 100;
     ram[indexRegister + 1] = (variableRegisters[X] / 10) % 10;
     ram[indexRegister + 2] = variableRegisters[X] % 10;
 }
 
 void Chip8::opRegistersToRam(byte X) {
+    if (!checkRange(indexRegister, X + 1)) {
+        return;
+    }
+    markDirty(indexRegister, X + 1);
     for (int i = 0; i <= X; i++) {
         ram[indexRegister + i] = variableRegisters[i];   
     }
 }
 
 void Chip8::opRamToRegisters(byte X) {
+    if (!checkRange(indexRegister, X + 1)) {
+        return;
+    }
     for (int i = 0; i <= X; i++) {
         variableRegisters[i] = ram[indexRegister + i];
     }
 }
 
 void Chip8::cycle() {
+    if (fault || !checkRange(programCounter, 2)) {
+        return;
+    }
+
     // Fetch
     word opcode = combine(ram[programCounter], ram[programCounter + 1]);
+
+#ifdef CHIP8_PROFILE
+    profile.cycles++;
+    profile.address[programCounter]++;
+    profile.opcodeFamily[opcode >> 12]++;
+#endif
+
     programCounter += 2;
     
     // Decode, Execute
@@ -372,25 +447,11 @@ void Chip8::reset() {
     // Clear display buffer
     opClear();
     
-    // Clear RAM
-    for (int i = 0; i < CHIP8_RAM_BYTES; i++) {
-        ram[i] = 0x00;
-    }
-
-    // Clear registers
-    for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
-        variableRegisters[i] = 0x0000;
-    }
-    
-    // Clear stack
-    for (int i = 0; i < CHIP8_STACK_HEIGHT; i++) {
-        stack[i] = 0x0000;
-    }
-
-    // Clear key buffer
-    for (int i = 0; i < 0xF; i++) {
-        keyState[i] = 0x00;
-    }
+    // Clear RAM, registers, stack and key buffer
+    memset(ram, 0, sizeof(ram));
+    memset(variableRegisters, 0, sizeof(variableRegisters));
+    memset(stack, 0, sizeof(stack));
+    memset(keyState, 0, sizeof(keyState));
 
     // Clear SP, PC, I, DT, ST 
     stackPointer    = 0x00;
@@ -400,28 +461,7 @@ void Chip8::reset() {
     soundTimer      = 0x00;
 
     // Load font
-    byte font[80] = { 
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-
-    for (int i = 0; i < 80; i++) {
-        ram[0x050 + i] = font[i];
-    }
+    memcpy(ram + 0x050, chip8Font, CHIP8_FONT_BYTES);
 
     // Set PC to start
     programCounter = 0x200;
@@ -429,58 +469,228 @@ void Chip8::reset() {
     // Set switch for FX0A
     blockingForKey = false;
     lastKeyFromBlock = false;
+
+    fault = CHIP8_FAULT_NONE;
+
+#ifdef CHIP8_PROFILE
+    memset(&profile, 0, sizeof(profile));
+#endif
+
+    // RAM no longer matches any snapshot
+    memset(pageOrigin, 0, sizeof(pageOrigin));
+    dirtyPages = 0;
+    markDirty(0, CHIP8_RAM_BYTES);
 }
 
-void Chip8::load(byte * rom)
+void Chip8::load(const byte * rom)
 {
-    for (int i = 0; i < CHIP8_RAM_BYTES - 512; i++) {
-        ram[512 + i] = rom[i];
+    memcpy(ram + 512, rom, CHIP8_RAM_BYTES - 512);
+    markDirty(512, CHIP8_RAM_BYTES - 512);
+}
+
+// Page ids, shared by every machine in the process
+static std::atomic<unsigned long> nextPageId(1);
+
+Chip8Snapshot Chip8::snapshot(const Chip8Snapshot * base)
+{
+    Chip8Snapshot snap;
+
+    for (int page = 0; page < CHIP8_RAM_PAGES; page++) {
+        bool clean = !(dirtyPages & (1u << page));
+
+        if (base && clean && base->pages[page] && base->pages[page]->id == pageOrigin[page]) {
+            snap.pages[page] = base->pages[page];
+            continue;
+        }
+
+        Chip8Page * copy = new Chip8Page;
+        copy->id = nextPageId++;
+        memcpy(copy->bytes, ram + page * CHIP8_PAGE_BYTES, CHIP8_PAGE_BYTES);
+        snap.pages[page].reset(copy);
+        pageOrigin[page] = copy->id;
+    }
+    dirtyPages = 0;
+
+    memcpy(snap.variableRegisters, variableRegisters, sizeof(variableRegisters));
+    memcpy(snap.stack, stack, sizeof(stack));
+    memcpy(snap.displayBuffer, displayBuffer, sizeof(displayBuffer));
+    memcpy(snap.keyState, keyState, sizeof(keyState));
+    snap.stackPointer       = stackPointer;
+    snap.programCounter     = programCounter;
+    snap.indexRegister      = indexRegister;
+    snap.delayTimer         = delayTimer;
+    snap.soundTimer         = soundTimer;
+    snap.draw               = draw;
+    snap.sound              = sound;
+    snap.copyBeforeShifting = copyBeforeShifting;
+    snap.blockingForKey     = blockingForKey;
+    snap.lastKey            = lastKey;
+    snap.lastKeyFromBlock   = lastKeyFromBlock;
+    snap.fault              = fault;
+
+    return snap;
+}
+
+void Chip8::resetTo(const Chip8Snapshot &snap)
+{
+    for (int page = 0; page < CHIP8_RAM_PAGES; page++) {
+        bool clean = !(dirtyPages & (1u << page));
+
+        if (clean && snap.pages[page]->id == pageOrigin[page]) {
+            continue;
+        }
+
+        memcpy(ram + page * CHIP8_PAGE_BYTES, snap.pages[page]->bytes, CHIP8_PAGE_BYTES);
+        pageOrigin[page] = snap.pages[page]->id;
+    }
+    dirtyPages = 0;
+
+    memcpy(variableRegisters, snap.variableRegisters, sizeof(variableRegisters));
+    memcpy(stack, snap.stack, sizeof(stack));
+    memcpy(displayBuffer, snap.displayBuffer, sizeof(displayBuffer));
+    memcpy(keyState, snap.keyState, sizeof(keyState));
+    stackPointer        = snap.stackPointer;
+    programCounter      = snap.programCounter;
+    indexRegister       = snap.indexRegister;
+    delayTimer          = snap.delayTimer;
+    soundTimer          = snap.soundTimer;
+    draw                = snap.draw;
+    sound               = snap.sound;
+    copyBeforeShifting  = snap.copyBeforeShifting;
+    blockingForKey      = snap.blockingForKey;
+    lastKey             = snap.lastKey;
+    lastKeyFromBlock    = snap.lastKeyFromBlock;
+    fault               = snap.fault;
+}
+
+static std::string displayText(const Chip8 &machine) {
+    std::string text = "===== DISPLAY ======\n";
+    for (int y = 0; y < CHIP8_SCREEN_HEIGHT; y++) {
+        for (int x = 0; x < CHIP8_SCREEN_WIDTH; x++) {
+            text += machine.pixel(x, y) ? "█" : "_";
+        }
+        text += "\n";
     }
+    return text;
 }
 
+// std::cerr is unbuffered, so the dumps build their text and write it once
 void Chip8::dumpState() {
-    std::cerr << "==== CHIP8 =====" << std::endl;
+    std::ostringstream out;
+
+    out << "==== CHIP8 =====\n";
     
-    std::cerr << "PC: " << std::hex << (int) programCounter << std::endl;
-    std::cerr << "SP: " << std::hex << (int) stackPointer << std::endl;
-    std::cerr << "IR: " << std::hex << (int) indexRegister << std::endl;
+    out << "PC: " << std::hex << (int) programCounter << "\n";
+    out << "SP: " << std::hex << (int) stackPointer << "\n";
+    out << "IR: " << std::hex << (int) indexRegister << "\n";
     
-    std::cerr << "== REGISTERS ===" << std::endl;
+    out << "== REGISTERS ===\n";
     for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
-        std::cerr << "V" << std::hex << i 
-        << ": " << std::hex << (int) variableRegisters[i] << std::endl;
+        out << "V" << std::hex << i 
+        << ": " << std::hex << (int) variableRegisters[i] << "\n";
     }
-    std::cerr << "=== TIMERS =====" << std::endl;
-    std::cerr << "DT: " << std::hex << (int) delayTimer << std::endl;
-    std::cerr << "ST: " << std::hex << (int) soundTimer << std::endl;
+    out << "=== TIMERS =====\n";
+    out << "DT: " << std::hex << (int) delayTimer << "\n";
+    out << "ST: " << std::hex << (int) soundTimer << "\n";
 
-    std::cerr << "===== KEYS =====" << std::endl;
-    for (int i = 0; i < 0xF; i++) {
+    out << "===== KEYS =====\n";
+    for (int i = 0; i < 16; i++) {
         char key = keyState[i] + '0';
-        std::cerr << "KEY " << std::hex << i << ": " << std::hex << key << std::endl; 
+        out << "KEY " << std::hex << i << ": " << std::hex << key << "\n"; 
     }
 
-    dumpDisplay();
+    out << displayText(*this);
 
-    std::cerr << "===== RAM ======" << std::endl;
-    for (int i = 0; i < CHIP8_RAM_BYTES; i++) {
-        if ( (i > 0) && (i % 4 == 0))
-            std::cerr << std::endl;
-        std::cerr << std::hex << i << ": " << std::hex << (int) ram[i] << "\t\t\t";
+    // 16 bytes a row, formatted into one buffer per row
+    out << "===== RAM ======\n";
+    for (int row = 0; row < CHIP8_RAM_BYTES; row += 16) {
+        char line[64];
+        int used = snprintf(line, sizeof(line), "%03x:", row);
+        for (int i = 0; i < 16; i++) {
+            used += snprintf(line + used, sizeof(line) - used, " %02x", ram[row + i]);
+        }
+        out << line << "\n";
     }
+    std::cerr << out.str();
 }
 
 void Chip8::dumpDisplay() {
-    std::cerr << "===== DISPLAY ======" << std::endl;
-    for (int y = 0; y < CHIP8_SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < CHIP8_SCREEN_WIDTH; x++) {
-            
-            if (displayBuffer[y][x]) {
-                std::cerr << "█";
-            } else {
-                std::cerr << "_";
+    std::cerr << displayText(*this);
+}
+
+#ifdef CHIP8_PROFILE
+int Chip8::hottestAddresses(word * out, int count) const {
+    int found = 0;
+
+    for (int pc = 0; pc < CHIP8_RAM_BYTES; pc++) {
+        if (!profile.address[pc]) {
+            continue;
+        }
+
+        // Insertion into a short sorted list
+        int slot = found < count ? found++ : count;
+        while (slot > 0 && profile.address[out[slot - 1]] < profile.address[pc]) {
+            if (slot < count) {
+                out[slot] = out[slot - 1];
             }
+            slot--;
+        }
+        if (slot < count) {
+            out[slot] = pc;
         }
-        std::cerr << "\n";
     }
-}
\ No newline at end of file
+
+    return found;
+}
+
+void Chip8::dumpProfile() {
+    static const char * families[16] = {
+        "0NNN clear/return", "1NNN jump", "2NNN call", "3XNN skip eq",
+        "4XNN skip ne", "5XY0 skip reg eq", "6XNN set", "7XNN add",
+        "8XYN logic/math", "9XY0 skip reg ne", "ANNN set index", "BNNN",
+        "CXNN random", "DXYN draw", "EXNN key skip", "FXNN misc"
+    };
+    double total = profile.cycles ? (double) profile.cycles : 1.0;
+
+    std::cerr << "==== PROFILE ====\n";
+    std::cerr << "cycles: " << std::dec << profile.cycles << "\n";
+
+    int order[16];
+    for (int i = 0; i < 16; i++) order[i] = i;
+    std::sort(order, order + 16, [this](int a, int b) {
+        return profile.opcodeFamily[a] > profile.opcodeFamily[b];
+    });
+
+    std::cerr << "== OPCODE FAMILIES ==\n";
+    for (int i = 0; i < 16 && profile.opcodeFamily[order[i]]; i++) {
+        std::cerr << std::setw(20) << std::left << families[order[i]] << std::right
+            << std::setw(14) << profile.opcodeFamily[order[i]]
+            << std::setw(8) << std::fixed << std::setprecision(2)
+            << 100.0 * profile.opcodeFamily[order[i]] / total << "%\n";
+    }
+
+    word hot[20];
+    int found = hottestAddresses(hot, 20);
+    double cumulative = 0;
+
+    std::cerr << "== HOT ADDRESSES ==\n";
+    std::cerr << "  addr  opcode         count   self%    cum%\n";
+    for (int i = 0; i < found; i++) {
+        double self = 100.0 * profile.address[hot[i]] / total;
+        cumulative += self;
+        std::cerr << "  " << std::hex << std::setw(4) << std::setfill('0') << hot[i]
+            << "  " << std::setw(4) << combine(ram[hot[i]], ram[(hot[i] + 1) % CHIP8_RAM_BYTES])
+            << std::setfill(' ') << std::dec << std::setw(14) << profile.address[hot[i]]
+            << std::setw(8) << self << std::setw(8) << cumulative << "\n";
+    }
+
+    std::cerr << "== WAITS & DRAWS ==\n";
+    std::cerr << "FX0A wait cycles: " << profile.keyWaitCycles
+        << " (" << 100.0 * profile.keyWaitCycles / total << "%)\n";
+    std::cerr << "draws: " << profile.draws << " frames: " << profile.frames;
+    if (profile.frames) {
+        std::cerr << " draws/frame: " << (double) profile.draws / profile.frames;
+    }
+    std::cerr << std::endl;
+}
+#endif
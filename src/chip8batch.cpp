@@ -0,0 +1,881 @@
+#include "chip8batch.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#ifdef CHIP8_AVX2
+#include <immintrin.h>
+#endif
+
+#define LANE_DISPLAY_BYTES (CHIP8_SCREEN_HEIGHT * sizeof(qword))
+
+static_assert(CHIP8_RAM_PAGES <= 32, "writtenPages holds a bit per page");
+
+// Whether an instruction can leave lanes at different PCs (faults aside)
+static bool mayBranch(word opcode) {
+    switch (opcode & 0xF000) {
+        case 0x0000:    return (opcode & 0x000F) == 0x000E;
+        case 0x8000:
+        case 0x6000:
+        case 0x7000:
+        case 0xA000:
+        case 0xC000:
+        case 0xD000:    return false;
+        case 0xF000:    return (opcode & 0x00FF) == 0x000A;
+    }
+    return true;
+}
+
+// Row kernels: each runs one instruction across n lanes, n a multiple of 32.
+// Flags are stored before the result is reloaded and written, as the scalar
+// handlers do, so X or Y being F behaves the same as in Chip8. There is a
+// scalar set and, when built with CHIP8_AVX2, an AVX2 set; the one used is
+// picked once for the CPU we're running on.
+struct RowKernels {
+    void (*addConst)(byte * vx, byte NN, int n);
+    void (*bitOr)(byte * vx, const byte * vy, int n);
+    void (*bitAnd)(byte * vx, const byte * vy, int n);
+    void (*bitXor)(byte * vx, const byte * vy, int n);
+    void (*addReg)(byte * vx, const byte * vy, byte * vf, int n);
+    void (*subLR)(byte * vx, const byte * vy, byte * vf, int n);
+    void (*subRL)(byte * vx, const byte * vy, byte * vf, int n);
+    void (*leftShift)(byte * vx, byte * vf, int n);
+    void (*rightShift)(byte * vx, byte * vf, int n);
+    void (*timers)(byte * dt, byte * stimer, byte * sound, int n);
+    bool (*pcsEqual)(const word * pc, int n);
+};
+
+static void rowAddConstScalar(byte * vx, byte NN, int n) {
+    for (int i = 0; i < n; i++) vx[i] += NN;
+}
+
+static void rowOrScalar(byte * vx, const byte * vy, int n) {
+    for (int i = 0; i < n; i++) vx[i] |= vy[i];
+}
+
+static void rowAndScalar(byte * vx, const byte * vy, int n) {
+    for (int i = 0; i < n; i++) vx[i] &= vy[i];
+}
+
+static void rowXorScalar(byte * vx, const byte * vy, int n) {
+    for (int i = 0; i < n; i++) vx[i] ^= vy[i];
+}
+
+static void rowAddRegScalar(byte * vx, const byte * vy, byte * vf, int n) {
+    for (int i = 0; i < n; i++) {
+        vf[i] = ((int) vx[i] + (int) vy[i]) > 0xFF;
+        vx[i] += vy[i];
+    }
+}
+
+static void rowSubLRScalar(byte * vx, const byte * vy, byte * vf, int n) {
+    for (int i = 0; i < n; i++) {
+        vf[i] = vx[i] >= vy[i];
+        vx[i] -= vy[i];
+    }
+}
+
+static void rowSubRLScalar(byte * vx, const byte * vy, byte * vf, int n) {
+    for (int i = 0; i < n; i++) {
+        vf[i] = vy[i] >= vx[i];
+        vx[i] = vy[i] - vx[i];
+    }
+}
+
+static void rowLeftShiftScalar(byte * vx, byte * vf, int n) {
+    for (int i = 0; i < n; i++) {
+        vf[i] = (vx[i] & 0x80) >> 7;
+        vx[i] = vx[i] << 1;
+    }
+}
+
+static void rowRightShiftScalar(byte * vx, byte * vf, int n) {
+    for (int i = 0; i < n; i++) {
+        vf[i] = vx[i] & 0x01;
+        vx[i] = vx[i] >> 1;
+    }
+}
+
+static void rowTimersScalar(byte * dt, byte * stimer, byte * sound, int n) {
+    for (int i = 0; i < n; i++) {
+        if (dt[i] > 0) dt[i]--;
+        sound[i] = stimer[i] > 0;
+        if (stimer[i] > 0) stimer[i]--;
+    }
+}
+
+// Whether pc[0..n) all equal pc[0]
+static bool pcsEqualScalar(const word * pc, int n) {
+    for (int lane = 1; lane < n; lane++) {
+        if (pc[lane] != pc[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const RowKernels scalarKernels = {
+    rowAddConstScalar, rowOrScalar, rowAndScalar, rowXorScalar, rowAddRegScalar, rowSubLRScalar, rowSubRLScalar,
+    rowLeftShiftScalar, rowRightShiftScalar, rowTimersScalar, pcsEqualScalar,
+};
+
+#ifdef CHIP8_AVX2
+
+// Built for AVX2 whatever the compiler's baseline, and only called when the CPU has it
+#define CHIP8_AVX2_TARGET __attribute__((target("avx2")))
+
+CHIP8_AVX2_TARGET static inline __m256i ld(const byte * p) { return _mm256_loadu_si256((const __m256i *) p); }
+CHIP8_AVX2_TARGET static inline void st(byte * p, __m256i v) { _mm256_storeu_si256((__m256i *) p, v); }
+
+CHIP8_AVX2_TARGET static void rowAddConstAvx2(byte * vx, byte NN, int n) {
+    __m256i k = _mm256_set1_epi8(NN);
+    for (int i = 0; i < n; i += 32) st(vx + i, _mm256_add_epi8(ld(vx + i), k));
+}
+
+CHIP8_AVX2_TARGET static void rowOrAvx2(byte * vx, const byte * vy, int n) {
+    for (int i = 0; i < n; i += 32) st(vx + i, _mm256_or_si256(ld(vx + i), ld(vy + i)));
+}
+
+CHIP8_AVX2_TARGET static void rowAndAvx2(byte * vx, const byte * vy, int n) {
+    for (int i = 0; i < n; i += 32) st(vx + i, _mm256_and_si256(ld(vx + i), ld(vy + i)));
+}
+
+CHIP8_AVX2_TARGET static void rowXorAvx2(byte * vx, const byte * vy, int n) {
+    for (int i = 0; i < n; i += 32) st(vx + i, _mm256_xor_si256(ld(vx + i), ld(vy + i)));
+}
+
+CHIP8_AVX2_TARGET static void rowAddRegAvx2(byte * vx, const byte * vy, byte * vf, int n) {
+    __m256i one = _mm256_set1_epi8(1);
+    for (int i = 0; i < n; i += 32) {
+        __m256i x = ld(vx + i), y = ld(vy + i);
+        __m256i sum = _mm256_add_epi8(x, y);
+        __m256i noCarry = _mm256_cmpeq_epi8(_mm256_min_epu8(sum, x), x);
+        st(vf + i, _mm256_andnot_si256(noCarry, one));
+        st(vx + i, _mm256_add_epi8(ld(vx + i), ld(vy + i)));
+    }
+}
+
+CHIP8_AVX2_TARGET static void rowSubLRAvx2(byte * vx, const byte * vy, byte * vf, int n) {
+    __m256i one = _mm256_set1_epi8(1);
+    for (int i = 0; i < n; i += 32) {
+        __m256i x = ld(vx + i), y = ld(vy + i);
+        st(vf + i, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, y), x), one));
+        st(vx + i, _mm256_sub_epi8(ld(vx + i), ld(vy + i)));
+    }
+}
+
+CHIP8_AVX2_TARGET static void rowSubRLAvx2(byte * vx, const byte * vy, byte * vf, int n) {
+    __m256i one = _mm256_set1_epi8(1);
+    for (int i = 0; i < n; i += 32) {
+        __m256i x = ld(vx + i), y = ld(vy + i);
+        st(vf + i, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, y), y), one));
+        st(vx + i, _mm256_sub_epi8(ld(vy + i), ld(vx + i)));
+    }
+}
+
+CHIP8_AVX2_TARGET static void rowLeftShiftAvx2(byte * vx, byte * vf, int n) {
+    __m256i one = _mm256_set1_epi8(1);
+    for (int i = 0; i < n; i += 32) {
+        st(vf + i, _mm256_and_si256(_mm256_srli_epi16(ld(vx + i), 7), one));
+        __m256i x = ld(vx + i);
+        st(vx + i, _mm256_add_epi8(x, x));
+    }
+}
+
+CHIP8_AVX2_TARGET static void rowRightShiftAvx2(byte * vx, byte * vf, int n) {
+    __m256i one = _mm256_set1_epi8(1);
+    __m256i low7 = _mm256_set1_epi8(0x7F);
+    for (int i = 0; i < n; i += 32) {
+        st(vf + i, _mm256_and_si256(ld(vx + i), one));
+        st(vx + i, _mm256_and_si256(_mm256_srli_epi16(ld(vx + i), 1), low7));
+    }
+}
+
+CHIP8_AVX2_TARGET static void rowTimersAvx2(byte * dt, byte * stimer, byte * sound, int n) {
+    __m256i one = _mm256_set1_epi8(1);
+    for (int i = 0; i < n; i += 32) {
+        st(dt + i, _mm256_subs_epu8(ld(dt + i), one));
+        __m256i s = ld(stimer + i);
+        st(sound + i, _mm256_min_epu8(s, one));
+        st(stimer + i, _mm256_subs_epu8(s, one));
+    }
+}
+
+CHIP8_AVX2_TARGET static bool pcsEqualAvx2(const word * pc, int n) {
+    __m256i first = _mm256_set1_epi16(pc[0]);
+    int lane = 0;
+    for (; lane + 16 <= n; lane += 16) {
+        __m256i eq = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *) (pc + lane)), first);
+        if (_mm256_movemask_epi8(eq) != -1) {
+            return false;
+        }
+    }
+    for (; lane < n; lane++) {
+        if (pc[lane] != pc[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const RowKernels avx2Kernels = {
+    rowAddConstAvx2, rowOrAvx2, rowAndAvx2, rowXorAvx2, rowAddRegAvx2, rowSubLRAvx2, rowSubRLAvx2,
+    rowLeftShiftAvx2, rowRightShiftAvx2, rowTimersAvx2, pcsEqualAvx2,
+};
+
+#endif // CHIP8_AVX2
+
+static const RowKernels * pickKernels() {
+#ifdef CHIP8_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2Kernels;
+    }
+#endif
+    return &scalarKernels;
+}
+
+static const RowKernels * const kernels = pickKernels();
+
+Chip8Batch::Chip8Batch(int lanes) {
+    laneCount = lanes;
+    laneStride = ((lanes + CHIP8_BATCH_LANE_ALIGN - 1) / CHIP8_BATCH_LANE_ALIGN) * CHIP8_BATCH_LANE_ALIGN;
+
+    variableRegisters.resize(CHIP8_VARIABLE_REGISTERS * laneStride);
+    stack.resize(CHIP8_STACK_HEIGHT * laneStride);
+    stackPointer.resize(laneStride);
+    programCounter.resize(laneStride);
+    indexRegister.resize(laneStride);
+    delayTimer.resize(laneStride);
+    soundTimer.resize(laneStride);
+
+    ram.resize(laneCount * CHIP8_RAM_BYTES);
+    displayBuffer.resize(laneCount * CHIP8_SCREEN_HEIGHT);
+    keyState.resize(laneCount * 16);
+
+    draw.resize(laneStride);
+    sound.resize(laneStride);
+    blockingForKey.resize(laneCount);
+    lastKey.resize(laneCount);
+    lastKeyFromBlock.resize(laneCount);
+    fault.resize(laneCount);
+
+    // Load user settings
+    copyBeforeShifting = false;
+
+    // Seed random number generator
+    srand(time(nullptr));
+
+    reset();
+}
+
+void Chip8Batch::reset() {
+    std::fill(variableRegisters.begin(), variableRegisters.end(), 0);
+    std::fill(stack.begin(), stack.end(), 0);
+    std::fill(stackPointer.begin(), stackPointer.end(), 0);
+    std::fill(programCounter.begin(), programCounter.end(), 0x200);
+    std::fill(indexRegister.begin(), indexRegister.end(), 0);
+    std::fill(delayTimer.begin(), delayTimer.end(), 0);
+    std::fill(soundTimer.begin(), soundTimer.end(), 0);
+
+    std::fill(ram.begin(), ram.end(), 0);
+    std::fill(displayBuffer.begin(), displayBuffer.end(), 0);
+    std::fill(keyState.begin(), keyState.end(), 0);
+
+    std::fill(draw.begin(), draw.end(), 0);
+    std::fill(sound.begin(), sound.end(), 0);
+    std::fill(blockingForKey.begin(), blockingForKey.end(), 0);
+    std::fill(lastKey.begin(), lastKey.end(), 0);
+    std::fill(lastKeyFromBlock.begin(), lastKeyFromBlock.end(), 0);
+    std::fill(fault.begin(), fault.end(), 0);
+
+    for (int lane = 0; lane < laneCount; lane++) {
+        memcpy(laneRam(lane) + 0x050, chip8Font, CHIP8_FONT_BYTES);
+    }
+
+    haltedCount = 0;
+    writtenPages = 0;
+    mayDiverge = true;
+    converged = false;
+    leadLane = 0;
+    lockstepSteps = 0;
+    divergentSteps = 0;
+}
+
+void Chip8Batch::load(const byte * rom) {
+    for (int lane = 0; lane < laneCount; lane++) {
+        memcpy(laneRam(lane) + 512, rom, CHIP8_RAM_BYTES - 512);
+    }
+    writtenPages = 0;
+    mayDiverge = true;
+}
+
+void Chip8Batch::step() {
+    if (mayDiverge) {
+        converged = pcsAgree(leadLane);
+        mayDiverge = false;
+    }
+
+    if (converged && stepLockstep()) {
+        return;
+    }
+
+    for (int lane = 0; lane < laneCount; lane++) {
+        stepLane(lane);
+    }
+    divergentSteps += laneCount - haltedCount;
+    mayDiverge = true;
+}
+
+void Chip8Batch::run(int cycles) {
+    for (int i = 0; i < cycles; i++) {
+        step();
+    }
+}
+
+bool Chip8Batch::pcsAgree(int &lead) const {
+    const word * pc = &programCounter[0];
+
+    // Halted lanes keep whatever PC they faulted at and don't count
+    if (haltedCount > 0) {
+        lead = -1;
+        for (int lane = 0; lane < laneCount; lane++) {
+            if (fault[lane]) {
+                continue;
+            }
+            if (lead < 0) {
+                lead = lane;
+            } else if (pc[lane] != pc[lead]) {
+                return false;
+            }
+        }
+        return lead >= 0;
+    }
+
+    lead = 0;
+    return kernels->pcsEqual(pc, laneCount);
+}
+
+bool Chip8Batch::opcodesAgree(word pc) const {
+    const byte * first = &ram[leadLane * CHIP8_RAM_BYTES];
+    for (int lane = leadLane + 1; lane < laneCount; lane++) {
+        if (fault[lane]) {
+            continue;
+        }
+        const byte * laneMem = &ram[lane * CHIP8_RAM_BYTES];
+        if (laneMem[pc] != first[pc] || laneMem[pc + 1] != first[pc + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Chip8Batch::stepLockstep() {
+    word pc = programCounter[leadLane];
+
+    if (pc + 2 > CHIP8_RAM_BYTES) {
+        return false;
+    }
+
+    // The opcode can only differ between lanes where some lane has written
+    unsigned int pages = (1U << (pc / CHIP8_PAGE_BYTES)) | (1U << ((pc + 1) / CHIP8_PAGE_BYTES));
+    if ((writtenPages & pages) && !opcodesAgree(pc)) {
+        return false;
+    }
+
+    if (haltedCount > 0) {
+        parkHalted();
+    }
+
+    // Fetch once for every lane
+    const byte * mem = &ram[leadLane * CHIP8_RAM_BYTES];
+    word opcode = combine(mem[pc], mem[pc + 1]);
+    std::fill(programCounter.begin(), programCounter.end(), pc + 2);
+
+    // Decode, Execute
+    int haltedBefore = haltedCount;
+    executeVector(opcode);
+
+    // Update timers
+    kernels->timers(&delayTimer[0], &soundTimer[0], &sound[0], laneStride);
+
+    if (haltedBefore > 0) {
+        unparkHalted();
+    }
+
+    lockstepSteps += laneCount - haltedCount;
+    return true;
+}
+
+void Chip8Batch::markWritten(word first, word last) {
+    for (int page = first / CHIP8_PAGE_BYTES; page <= last / CHIP8_PAGE_BYTES; page++) {
+        writtenPages |= 1U << page;
+    }
+}
+
+// 2NNN for every lane at once; false if any lane would overflow, so the fallback faults it
+bool Chip8Batch::callVector(word NNN) {
+    for (int lane = 0; lane < laneCount; lane++) {
+        if (!fault[lane] && stackPointer[lane] >= CHIP8_STACK_HEIGHT) {
+            return false;
+        }
+    }
+
+    word returnTo = programCounter[leadLane];
+    for (int lane = 0; lane < laneCount; lane++) {
+        if (!fault[lane]) {
+            stack[stackPointer[lane]++ * laneStride + lane] = returnTo;
+        }
+    }
+    std::fill(programCounter.begin(), programCounter.end(), NNN);
+    return true;
+}
+
+// 00EE for every lane at once; lanes stay converged if they all return to the same place
+bool Chip8Batch::returnVector() {
+    for (int lane = 0; lane < laneCount; lane++) {
+        if (!fault[lane] && stackPointer[lane] == 0) {
+            return false;
+        }
+    }
+
+    word leadTarget = stack[(stackPointer[leadLane] - 1) * laneStride + leadLane];
+    for (int lane = 0; lane < laneCount; lane++) {
+        if (fault[lane]) {
+            continue;
+        }
+        word target = stack[--stackPointer[lane] * laneStride + lane];
+        programCounter[lane] = target;
+        if (target != leadTarget) {
+            mayDiverge = true;
+        }
+    }
+    return true;
+}
+
+void Chip8Batch::parkHalted() {
+    parked.clear();
+    for (int lane = 0; lane < laneCount; lane++) {
+        if (!fault[lane]) {
+            continue;
+        }
+
+        ParkedLane p;
+        p.lane = lane;
+        for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
+            p.registers[i] = variableRegisters[i * laneStride + lane];
+        }
+        p.programCounter = programCounter[lane];
+        p.indexRegister = indexRegister[lane];
+        p.delayTimer = delayTimer[lane];
+        p.soundTimer = soundTimer[lane];
+        p.sound = sound[lane];
+        parked.push_back(p);
+    }
+}
+
+void Chip8Batch::unparkHalted() {
+    for (size_t i = 0; i < parked.size(); i++) {
+        const ParkedLane &p = parked[i];
+        for (int r = 0; r < CHIP8_VARIABLE_REGISTERS; r++) {
+            variableRegisters[r * laneStride + p.lane] = p.registers[r];
+        }
+        programCounter[p.lane] = p.programCounter;
+        indexRegister[p.lane] = p.indexRegister;
+        delayTimer[p.lane] = p.delayTimer;
+        soundTimer[p.lane] = p.soundTimer;
+        sound[p.lane] = p.sound;
+    }
+}
+
+void Chip8Batch::executeVector(word opcode) {
+    byte X = (opcode & 0x0F00) >> 8;
+    byte Y = (opcode & 0x00F0) >> 4;
+    word NN = opcode & 0x00FF;
+    word NNN = opcode & 0x0FFF;
+    int n = laneStride;
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if ((opcode & 0x000F) == 0x000E && returnVector()) {
+                return;
+            }
+            break;
+        case 0x1000:
+            std::fill(programCounter.begin(), programCounter.end(), NNN);
+            return;
+        case 0x2000:
+            if (callVector(NNN)) {
+                return;
+            }
+            break;
+        case 0x6000:
+            memset(row(X), NN, n);
+            return;
+        case 0x7000:
+            kernels->addConst(row(X), NN, n);
+            return;
+        case 0xA000:
+            std::fill(indexRegister.begin(), indexRegister.end(), NNN);
+            return;
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0000:    memmove(row(X), row(Y), n);             return;
+                case 0x0001:    kernels->bitOr(row(X), row(Y), n);               return;
+                case 0x0002:    kernels->bitAnd(row(X), row(Y), n);              return;
+                case 0x0003:    kernels->bitXor(row(X), row(Y), n);              return;
+                case 0x0004:    kernels->addReg(row(X), row(Y), row(0xF), n); return;
+                case 0x0005:    kernels->subLR(row(X), row(Y), row(0xF), n);  return;
+                case 0x0007:    kernels->subRL(row(X), row(Y), row(0xF), n);  return;
+                case 0x000E:
+                    if (copyBeforeShifting) memmove(row(X), row(Y), n);
+                    kernels->leftShift(row(X), row(0xF), n);
+                    return;
+                case 0x0006:
+                    if (copyBeforeShifting) memmove(row(X), row(Y), n);
+                    kernels->rightShift(row(X), row(0xF), n);
+                    return;
+            }
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0007:    memcpy(row(X), &delayTimer[0], n);                      return;
+                case 0x0015:    std::fill(delayTimer.begin(), delayTimer.end(), X);     return;
+                case 0x0018:    std::fill(soundTimer.begin(), soundTimer.end(), X);     return;
+                case 0x001E: {
+                    word * I = &indexRegister[0];
+                    const byte * vx = row(X);
+                    byte * vf = row(0xF);
+                    for (int i = 0; i < n; i++) {
+                        if ((int) I[i] + (int) X > 0x1000) vf[i] = 1;
+                        I[i] += vx[i];
+                    }
+                    return;
+                }
+            }
+            break;
+        case 0xD000:
+            // Per lane by nature, but decoded once
+            for (int lane = 0; lane < laneCount; lane++) {
+                if (!fault[lane]) {
+                    drawLane(lane, X, Y, opcode & 0x000F);
+                }
+            }
+            if (haltedCount) {
+                mayDiverge = true;
+            }
+            return;
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000: {
+            // Skips: branch-free per lane, the PCs split only if the condition does
+            word * pc = &programCounter[0];
+            const byte * vx = row(X);
+            const byte * vy = row(Y);
+            switch (opcode & 0xF000) {
+                case 0x3000:    for (int i = 0; i < n; i++) pc[i] += (vx[i] == NN) << 1;      break;
+                case 0x4000:    for (int i = 0; i < n; i++) pc[i] += (vx[i] != NN) << 1;      break;
+                case 0x5000:    for (int i = 0; i < n; i++) pc[i] += (vx[i] == vy[i]) << 1;   break;
+                case 0x9000:    for (int i = 0; i < n; i++) pc[i] += (vx[i] != vy[i]) << 1;   break;
+            }
+            mayDiverge = true;
+            return;
+        }
+    }
+
+    // Everything else runs lane by lane; only branches and faults can leave the PCs apart
+    int haltedBefore = haltedCount;
+    for (int lane = 0; lane < laneCount; lane++) {
+        if (!fault[lane]) {
+            executeLane(lane, opcode);
+        }
+    }
+    if (mayBranch(opcode) || haltedCount != haltedBefore) {
+        mayDiverge = true;
+    }
+}
+
+void Chip8Batch::haltLane(int lane, Chip8Fault why) {
+    fault[lane] = why;
+    haltedCount++;
+}
+
+void Chip8Batch::stepLane(int lane) {
+    if (fault[lane]) {
+        return;
+    }
+
+    // Fetch
+    byte * mem = laneRam(lane);
+    word pc = programCounter[lane];
+    if (pc + 2 > CHIP8_RAM_BYTES) {
+        haltLane(lane, CHIP8_FAULT_RAM_RANGE);
+        return;
+    }
+    word opcode = combine(mem[pc], mem[pc + 1]);
+    programCounter[lane] = pc + 2;
+
+    // Decode, Execute
+    executeLane(lane, opcode);
+
+    // Update timers
+    if (delayTimer[lane] > 0) {
+        delayTimer[lane]--;
+    }
+
+    if (soundTimer[lane] > 0) {
+        sound[lane] = true;
+        soundTimer[lane]--;
+    } else {
+        sound[lane] = false;
+    }
+}
+
+void Chip8Batch::executeLane(int lane, word opcode) {
+    byte X = (opcode & 0x0F00) >> 8;
+    byte Y = (opcode & 0x00F0) >> 4;
+    byte N = (opcode & 0x000F);
+    word NN = opcode & 0x00FF;
+    word NNN = opcode & 0x0FFF;
+
+    int s = laneStride;
+    byte & VX = variableRegisters[X * s + lane];
+    byte & VY = variableRegisters[Y * s + lane];
+    byte & VF = variableRegisters[0xF * s + lane];
+    word & pc = programCounter[lane];
+    word & I = indexRegister[lane];
+    byte & sp = stackPointer[lane];
+    byte * mem = laneRam(lane);
+    byte * keys = laneKeys(lane);
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            switch (opcode & 0x000F) {
+                case 0x0000:
+                    memset(laneDisplay(lane), 0, LANE_DISPLAY_BYTES);
+                    break;
+                case 0x000E:
+                    if (sp == 0) {
+                        haltLane(lane, CHIP8_FAULT_STACK_UNDERFLOW);
+                        break;
+                    }
+                    pc = stack[--sp * s + lane];
+                    break;
+            }
+            break;
+        case 0x1000:
+            pc = NNN;
+            break;
+        case 0x2000:
+            if (sp >= CHIP8_STACK_HEIGHT) {
+                haltLane(lane, CHIP8_FAULT_STACK_OVERFLOW);
+                break;
+            }
+            stack[sp++ * s + lane] = pc;
+            pc = NNN;
+            break;
+        case 0x3000:    if (VX == NN) pc += 2;      break;
+        case 0x4000:    if (VX != NN) pc += 2;      break;
+        case 0x5000:    if (VX == VY) pc += 2;      break;
+        case 0x6000:    VX = NN;                    break;
+        case 0x7000:    VX += NN;                   break;
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0000:    VX = VY;            break;
+                case 0x0001:    VX = VX | VY;       break;
+                case 0x0002:    VX = VX & VY;       break;
+                case 0x0003:    VX = VX ^ VY;       break;
+                case 0x0004:
+                    VF = ((int) VX + (int) VY) > 0xFF;
+                    VX += VY;
+                    break;
+                case 0x0005:
+                    VF = VX >= VY;
+                    VX -= VY;
+                    break;
+                case 0x0007:
+                    VF = VY >= VX;
+                    VX = VY - VX;
+                    break;
+                case 0x000E:
+                    if (copyBeforeShifting) VX = VY;
+                    VF = (VX & 0x80) >> 7;
+                    VX = VX << 1;
+                    break;
+                case 0x0006:
+                    if (copyBeforeShifting) VX = VY;
+                    VF = VX & 0x01;
+                    VX = VX >> 1;
+                    break;
+            }
+            break;
+        case 0x9000:    if (VX != VY) pc += 2;      break;
+        case 0xA000:    I = NNN;                    break;
+        case 0xC000:    VX = rand() & NN;           break;
+        case 0xD000:    drawLane(lane, X, Y, N);    break;
+        case 0xE000: {
+            if (VX > 0xF) {
+                haltLane(lane, CHIP8_FAULT_BAD_KEY);
+                break;
+            }
+            byte state = keys[VX];
+            switch (opcode & 0x000F) {
+                case 0x000E:    if (state == 1) pc += 2;    break;
+                case 0x0001:    if (state == 0) pc += 2;    break;
+            }
+            break;
+        }
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0029:    I = mem[0x050 + (5 * X)];   break;
+                case 0x0033:
+                    if (I + 3 > CHIP8_RAM_BYTES) {
+                        haltLane(lane, CHIP8_FAULT_RAM_RANGE);
+                        break;
+                    }
+                    mem[I] = VX / 100;
+                    mem[I + 1] = (VX / 10) % 10;
+                    mem[I + 2] = VX % 10;
+                    markWritten(I, I + 2);
+                    break;
+                case 0x0007:    VX = delayTimer[lane];      break;
+                case 0x0015:    delayTimer[lane] = X;       break;
+                case 0x0018:    soundTimer[lane] = X;       break;
+                case 0x000A:
+                    blockingForKey[lane] = true;
+                    if (lastKeyFromBlock[lane] && (keys[lastKey[lane]] == 0)) {
+                        VX = lastKey[lane];
+                        blockingForKey[lane] = false;
+                        break;
+                    }
+                    pc -= 2;
+                    break;
+                case 0x001E:
+                    if ((int) I + (int) X > 0x1000) VF = 1;
+                    I += VX;
+                    break;
+                case 0x0055:
+                    if (I + X + 1 > CHIP8_RAM_BYTES) {
+                        haltLane(lane, CHIP8_FAULT_RAM_RANGE);
+                        break;
+                    }
+                    for (int i = 0; i <= X; i++) {
+                        mem[I + i] = variableRegisters[i * s + lane];
+                    }
+                    markWritten(I, I + X);
+                    break;
+                case 0x0065:
+                    if (I + X + 1 > CHIP8_RAM_BYTES) {
+                        haltLane(lane, CHIP8_FAULT_RAM_RANGE);
+                        break;
+                    }
+                    for (int i = 0; i <= X; i++) {
+                        variableRegisters[i * s + lane] = mem[I + i];
+                    }
+                    break;
+            }
+            break;
+        default:
+            haltLane(lane, CHIP8_FAULT_BAD_OPCODE);
+            break;
+    }
+}
+
+void Chip8Batch::drawLane(int lane, byte X, byte Y, byte N) {
+    int s = laneStride;
+    byte * mem = laneRam(lane);
+    qword * display = laneDisplay(lane);
+    word I = indexRegister[lane];
+
+    byte xCoord = variableRegisters[X * s + lane] % CHIP8_SCREEN_WIDTH;
+    byte yCoord = variableRegisters[Y * s + lane] % CHIP8_SCREEN_HEIGHT;
+
+    draw[lane] = false;
+    variableRegisters[0xF * s + lane] = 0;
+
+    if (I + N > CHIP8_RAM_BYTES) {
+        haltLane(lane, CHIP8_FAULT_RAM_RANGE);
+        return;
+    }
+
+    for (int y = 0; y < N && yCoord + y < CHIP8_SCREEN_HEIGHT; y++) {
+        qword sprite = spriteMask(mem[I + y], xCoord);
+        qword &row = display[yCoord + y];
+
+        if (row & sprite) {
+            variableRegisters[0xF * s + lane] = 1;
+        }
+        if (sprite) {
+            draw[lane] = true;
+        }
+        row ^= sprite;
+    }
+}
+
+void Chip8Batch::copyLaneTo(int lane, Chip8 &out) const {
+    int s = laneStride;
+
+    memcpy(out.ram, &ram[lane * CHIP8_RAM_BYTES], CHIP8_RAM_BYTES);
+    out.markDirty(0, CHIP8_RAM_BYTES);
+    memcpy(out.displayBuffer, &displayBuffer[lane * CHIP8_SCREEN_HEIGHT], LANE_DISPLAY_BYTES);
+    memcpy(out.keyState, &keyState[lane * 16], 16);
+
+    for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
+        out.variableRegisters[i] = variableRegisters[i * s + lane];
+    }
+    for (int i = 0; i < CHIP8_STACK_HEIGHT; i++) {
+        out.stack[i] = stack[i * s + lane];
+    }
+
+    out.stackPointer = stackPointer[lane];
+    out.programCounter = programCounter[lane];
+    out.indexRegister = indexRegister[lane];
+    out.delayTimer = delayTimer[lane];
+    out.soundTimer = soundTimer[lane];
+    out.draw = draw[lane];
+    out.sound = sound[lane];
+    out.copyBeforeShifting = copyBeforeShifting;
+    out.blockingForKey = blockingForKey[lane];
+    out.lastKey = lastKey[lane];
+    out.lastKeyFromBlock = lastKeyFromBlock[lane];
+    out.fault = (Chip8Fault) fault[lane];
+}
+
+void Chip8Batch::copyLaneFrom(int lane, const Chip8 &in) {
+    int s = laneStride;
+
+    memcpy(&ram[lane * CHIP8_RAM_BYTES], in.ram, CHIP8_RAM_BYTES);
+    memcpy(&displayBuffer[lane * CHIP8_SCREEN_HEIGHT], in.displayBuffer, LANE_DISPLAY_BYTES);
+    memcpy(&keyState[lane * 16], in.keyState, 16);
+
+    for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
+        variableRegisters[i * s + lane] = in.variableRegisters[i];
+    }
+    for (int i = 0; i < CHIP8_STACK_HEIGHT; i++) {
+        stack[i * s + lane] = in.stack[i];
+    }
+
+    stackPointer[lane] = in.stackPointer;
+    programCounter[lane] = in.programCounter;
+    indexRegister[lane] = in.indexRegister;
+    delayTimer[lane] = in.delayTimer;
+    soundTimer[lane] = in.soundTimer;
+    draw[lane] = in.draw;
+    sound[lane] = in.sound;
+    blockingForKey[lane] = in.blockingForKey;
+    lastKey[lane] = in.lastKey;
+    lastKeyFromBlock[lane] = in.lastKeyFromBlock;
+
+    if (fault[lane]) {
+        haltedCount--;
+    }
+    fault[lane] = in.fault;
+    if (fault[lane]) {
+        haltedCount++;
+    }
+
+    // This lane's code may now differ from the others
+    writtenPages = ~0U;
+    mayDiverge = true;
+}
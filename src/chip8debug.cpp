@@ -0,0 +1,159 @@
+#include "chip8debug.hpp"
+#include "chip8trace.hpp"
+#include <cstdio>
+#include <cstring>
+
+Chip8Debugger::Chip8Debugger(Chip8 &machine) : machine(machine) {
+    tracer = nullptr;
+    clear();
+}
+
+void Chip8Debugger::setBreakpoint(word pc, bool on) {
+    pc %= CHIP8_RAM_BYTES;
+    if (hasBreakpoint(pc) == on) {
+        return;
+    }
+    breakpoints[pc / 64] ^= 1ULL << (pc % 64);
+    breakpointCount += on ? 1 : -1;
+}
+
+bool Chip8Debugger::toggleBreakpoint(word pc) {
+    pc %= CHIP8_RAM_BYTES;
+    setBreakpoint(pc, !hasBreakpoint(pc));
+    return hasBreakpoint(pc);
+}
+
+void Chip8Debugger::clear() {
+    memset(breakpoints, 0, sizeof(breakpoints));
+    breakpointCount = 0;
+    conditions.clear();
+    conditionHeld.clear();
+    watches.clear();
+    stopReason = CHIP8_STOP_NONE;
+    stopPc = 0;
+    stopAddress = 0;
+    resuming = false;
+}
+
+bool Chip8Debugger::conditionHolds(const Chip8Condition &condition) const {
+    if (condition.pc != CHIP8_DEBUG_ANY_PC && condition.pc != machine.programCounter) {
+        return false;
+    }
+
+    byte value = machine.variableRegisters[condition.X & 0xF];
+    switch (condition.compare) {
+        case CHIP8_COMPARE_EQ:  return value == condition.value;
+        case CHIP8_COMPARE_NE:  return value != condition.value;
+        case CHIP8_COMPARE_LT:  return value < condition.value;
+        case CHIP8_COMPARE_LE:  return value <= condition.value;
+        case CHIP8_COMPARE_GT:  return value > condition.value;
+        case CHIP8_COMPARE_GE:  return value >= condition.value;
+    }
+    return false;
+}
+
+bool Chip8Debugger::checkWatches(word first, word last, bool write) {
+    for (size_t i = 0; i < watches.size(); i++) {
+        const Chip8Watch &watch = watches[i];
+
+        if ((write ? watch.onWrite : watch.onRead) && first <= watch.last && last >= watch.first) {
+            stopReason = write ? CHIP8_STOP_WRITE : CHIP8_STOP_READ;
+            stopAddress = first > watch.first ? first : watch.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decode the next instruction's RAM accesses without executing it
+bool Chip8Debugger::shouldStop() {
+    word pc = machine.programCounter;
+
+    if (pc + 1 >= CHIP8_RAM_BYTES) {
+        return false;
+    }
+
+    // Every condition is re-checked so none misses its false -> true edge
+    bool rose = false;
+    for (size_t i = 0; i < conditions.size(); i++) {
+        bool holds = conditionHolds(conditions[i]);
+        rose |= holds && !conditionHeld[i];
+        conditionHeld[i] = holds;
+    }
+
+    if (hasBreakpoint(pc)) {
+        stopReason = CHIP8_STOP_BREAKPOINT;
+        return true;
+    }
+    if (rose) {
+        stopReason = CHIP8_STOP_CONDITION;
+        return true;
+    }
+    if (watches.empty()) {
+        return false;
+    }
+
+    word opcode = combine(machine.ram[pc], machine.ram[pc + 1]);
+    byte X = (opcode >> 8) & 0xF;
+    word I = machine.indexRegister;
+
+    if ((opcode & 0xF000) == 0xD000 && (opcode & 0xF)) {
+        return checkWatches(I, I + (opcode & 0xF) - 1, false);
+    }
+    switch (opcode & 0xF0FF) {
+        case 0xF033:    return checkWatches(I, I + 2, true);
+        case 0xF055:    return checkWatches(I, I + X, true);
+        case 0xF065:    return checkWatches(I, I + X, false);
+    }
+    return false;
+}
+
+int Chip8Debugger::run(int cycles) {
+    stopReason = CHIP8_STOP_NONE;
+
+    for (int i = 0; i < cycles; i++) {
+        if (!resuming && shouldStop()) {
+            stopPc = machine.programCounter;
+            resuming = true;
+            return i;
+        }
+        resuming = false;
+
+        if (tracer) {
+            tracer->step();
+        } else {
+            machine.cycle();
+        }
+
+        if (machine.fault) {
+            stopReason = CHIP8_STOP_FAULT;
+            stopPc = machine.programCounter;
+            return i + 1;
+        }
+    }
+    return cycles;
+}
+
+const char * Chip8Debugger::describeStop(char * buf, int size) const {
+    switch (stopReason) {
+        case CHIP8_STOP_NONE:
+            snprintf(buf, size, "RUNNING");
+            break;
+        case CHIP8_STOP_BREAKPOINT:
+            snprintf(buf, size, "BREAK AT %04x", stopPc);
+            break;
+        case CHIP8_STOP_CONDITION:
+            snprintf(buf, size, "CONDITION AT %04x", stopPc);
+            break;
+        case CHIP8_STOP_READ:
+            snprintf(buf, size, "READ %04x AT %04x", stopAddress, stopPc);
+            break;
+        case CHIP8_STOP_WRITE:
+            snprintf(buf, size, "WRITE %04x AT %04x", stopAddress, stopPc);
+            break;
+        case CHIP8_STOP_FAULT:
+            snprintf(buf, size, "%s AT %04x", faultName(machine.fault), stopPc);
+            break;
+    }
+    return buf;
+}
@@ -0,0 +1,155 @@
+#include "chip8env.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <new>
+#include <unistd.h>
+
+void packDisplay(const Chip8 &machine, byte * frame) {
+    for (int y = 0; y < CHIP8_SCREEN_HEIGHT; y++) {
+        qword row = machine.displayBuffer[y];
+        for (int shift = CHIP8_SCREEN_WIDTH - 8; shift >= 0; shift -= 8) {
+            *frame++ = (byte) (row >> shift);
+        }
+    }
+}
+
+unsigned long hashFrame(const byte * frame) {
+    unsigned long hash = 14695981039346656037UL;
+    for (int i = 0; i < CHIP8_ENV_FRAME_BYTES; i++) {
+        hash = (hash ^ frame[i]) * 1099511628211UL;
+    }
+    return hash;
+}
+
+Chip8SharedFrames::Chip8SharedFrames() {
+    base = nullptr;
+    slotCount = 0;
+    fd = -1;
+}
+
+Chip8SharedFrames::~Chip8SharedFrames() {
+    close();
+}
+
+bool Chip8SharedFrames::open(const char * name, int slots, bool create) {
+    size_t bytes = (size_t) slots * CHIP8_ENV_FRAME_BYTES;
+
+    close();
+    fd = shm_open(name, create ? (O_RDWR | O_CREAT) : O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (create && ftruncate(fd, bytes) != 0) {
+        close();
+        return false;
+    }
+
+    // A producer set up for a different slot count would have us read past its end
+    if (!create) {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close();
+            return false;
+        }
+        if ((size_t) info.st_size != bytes) {
+            close();
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    void * mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    base = (byte *) mapped;
+    slotCount = slots;
+    return true;
+}
+
+void Chip8SharedFrames::close() {
+    if (base) {
+        munmap(base, (size_t) slotCount * CHIP8_ENV_FRAME_BYTES);
+        base = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    slotCount = 0;
+}
+
+bool Chip8SharedFrames::unlink(const char * name) {
+    return shm_unlink(name) == 0;
+}
+
+void * Chip8Env::operator new(size_t size) {
+    void * p = nullptr;
+    if (posix_memalign(&p, alignof(Chip8Env), size) != 0) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void Chip8Env::operator delete(void * p) {
+    free(p);
+}
+
+Chip8Env::Chip8Env(const byte * rom, byte * observation) {
+    cyclesPerFrame = CHIP8_ENV_CYCLES_PER_FRAME;
+    frame = observation ? observation : ownFrame;
+
+    machine.load(rom);
+    start = machine.snapshot();
+    reset();
+}
+
+unsigned long Chip8Env::reset() {
+    machine.resetTo(start);
+    heldKeys = 0;
+
+    packDisplay(machine, frame);
+    return hashFrame(frame);
+}
+
+void Chip8Env::applyKeys(word actionMask) {
+    word pressed = actionMask & ~heldKeys;
+
+    for (int key = 0; key < 16; key++) {
+        machine.keyState[key] = (actionMask >> key) & 1;
+
+        // Newly pressed keys feed FX0A the same way the frontend does
+        if ((pressed >> key) & 1) {
+            if (machine.blockingForKey) {
+                machine.lastKeyFromBlock = true;
+            }
+            machine.lastKey = key;
+        }
+    }
+
+    heldKeys = actionMask;
+}
+
+Chip8StepResult Chip8Env::step(word actionMask, int frameSkip) {
+    Chip8StepResult result;
+
+    applyKeys(actionMask);
+
+    for (int i = 0; i < frameSkip * cyclesPerFrame; i++) {
+        machine.cycle();
+    }
+
+    packDisplay(machine, frame);
+    result.frameHash = hashFrame(frame);
+    result.reward = rewardHook ? rewardHook(machine) : 0.0f;
+    result.done = machine.fault || (doneHook && doneHook(machine));
+
+    return result;
+}
@@ -0,0 +1,179 @@
+#include "chip8export.hpp"
+#include <cstring>
+
+Chip8FrameExport::Chip8FrameExport() {
+    every = 1;
+    scale = 1;
+    framesSeen = 0;
+    framesWritten = 0;
+    framesSkipped = 0;
+    stalls = 0;
+    out = nullptr;
+    format = CHIP8_EXPORT_PBM;
+    haveLast = false;
+    head = 0;
+    tail = 0;
+    stopping = false;
+}
+
+Chip8FrameExport::~Chip8FrameExport() {
+    close();
+}
+
+bool Chip8FrameExport::open(const char * path, Chip8ExportFormat format) {
+    out = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (!out) {
+        return false;
+    }
+
+    this->format = format;
+    if (scale < 1) {
+        scale = 1;
+    }
+    if (scale > CHIP8_EXPORT_MAX_SCALE) {
+        scale = CHIP8_EXPORT_MAX_SCALE;
+    }
+    if (every < 1) {
+        every = 1;
+    }
+
+    int width = CHIP8_SCREEN_WIDTH * scale;
+    int height = CHIP8_SCREEN_HEIGHT * scale;
+
+    // Largest frame plus its header
+    buffer.resize(64 + (size_t) width * height);
+
+    if (format == CHIP8_EXPORT_Y4M) {
+        fprintf(out, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n", width, height);
+    }
+
+    haveLast = false;
+    head = tail = 0;
+    stopping = false;
+    writer = std::thread(&Chip8FrameExport::writeFrames, this);
+    return true;
+}
+
+void Chip8FrameExport::close() {
+    if (!out) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    if (out == stdout) {
+        fflush(out);
+    } else {
+        fclose(out);
+    }
+    out = nullptr;
+}
+
+void Chip8FrameExport::frame(const Chip8 &machine) {
+    if (framesSeen++ % every != 0) {
+        return;
+    }
+
+    // 256 bytes; cheaper than anything the writer would do with a repeat
+    if (haveLast && memcmp(last, machine.displayBuffer, sizeof(last)) == 0) {
+        framesSkipped++;
+        return;
+    }
+    memcpy(last, machine.displayBuffer, sizeof(last));
+    haveLast = true;
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (head - tail == CHIP8_EXPORT_QUEUE_FRAMES) {
+            stalls++;
+            while (head - tail == CHIP8_EXPORT_QUEUE_FRAMES) {
+                changed.wait(guard);
+            }
+        }
+    }
+
+    // Only the writer moves tail, and it never reads past head
+    memcpy(queue[head % CHIP8_EXPORT_QUEUE_FRAMES], last, sizeof(last));
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        head++;
+    }
+    changed.notify_all();
+}
+
+size_t Chip8FrameExport::encode(const qword * display) {
+    int width = CHIP8_SCREEN_WIDTH * scale;
+    byte * p = buffer.data();
+
+    if (format == CHIP8_EXPORT_Y4M) {
+        memcpy(p, "FRAME\n", 6);
+        p += 6;
+
+        for (int y = 0; y < CHIP8_SCREEN_HEIGHT; y++) {
+            byte * line = p;
+            for (int x = 0; x < CHIP8_SCREEN_WIDTH; x++) {
+                byte luma = (display[y] >> (CHIP8_SCREEN_WIDTH - 1 - x)) & 1 ? 235 : 16;
+                memset(p, luma, scale);
+                p += scale;
+            }
+            for (int repeat = 1; repeat < scale; repeat++) {
+                memcpy(p, line, width);
+                p += width;
+            }
+        }
+    } else {
+        p += sprintf((char *) p, "P4\n%d %d\n", width, CHIP8_SCREEN_HEIGHT * scale);
+
+        // Rows are whole bytes: 64 * scale is always a multiple of 8
+        for (int y = 0; y < CHIP8_SCREEN_HEIGHT; y++) {
+            byte * line = p;
+            int bit = 7;
+            *p = 0;
+            for (int x = 0; x < CHIP8_SCREEN_WIDTH; x++) {
+                int lit = (display[y] >> (CHIP8_SCREEN_WIDTH - 1 - x)) & 1;
+                for (int repeat = 0; repeat < scale; repeat++) {
+                    *p |= lit << bit;
+                    if (--bit < 0) {
+                        *++p = 0;
+                        bit = 7;
+                    }
+                }
+            }
+            for (int repeat = 1; repeat < scale; repeat++) {
+                memcpy(p, line, width / 8);
+                p += width / 8;
+            }
+        }
+    }
+
+    return p - buffer.data();
+}
+
+void Chip8FrameExport::writeFrames() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (head == tail && !stopping) {
+                changed.wait(guard);
+            }
+            if (head == tail) {
+                return;
+            }
+        }
+
+        size_t size = encode(queue[tail % CHIP8_EXPORT_QUEUE_FRAMES]);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            tail++;
+        }
+        changed.notify_all();
+
+        fwrite(buffer.data(), 1, size, out);
+        framesWritten++;
+    }
+}
@@ -0,0 +1,120 @@
+#include "chip8live.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Chip8LiveExport::Chip8LiveExport() {
+    segment = nullptr;
+    fd = -1;
+}
+
+Chip8LiveExport::~Chip8LiveExport() {
+    close();
+}
+
+bool Chip8LiveExport::open(const char * name, bool create) {
+    close();
+    fd = shm_open(name, create ? (O_RDWR | O_CREAT) : O_RDONLY, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (create && ftruncate(fd, sizeof(Chip8LiveSegment)) != 0) {
+        close();
+        return false;
+    }
+
+    // Mapping past the end of a short segment would fault on the first read
+    if (!create) {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close();
+            return false;
+        }
+        if ((size_t) info.st_size < sizeof(Chip8LiveSegment)) {
+            close();
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    void * mapped = mmap(nullptr, sizeof(Chip8LiveSegment), create ? (PROT_READ | PROT_WRITE) : PROT_READ,
+        MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    segment = (Chip8LiveSegment *) mapped;
+    if (create) {
+        memset(&segment->state, 0, sizeof(segment->state));
+        segment->sequence.store(0, std::memory_order_relaxed);
+        segment->version = CHIP8_LIVE_VERSION;
+        segment->magic = CHIP8_LIVE_MAGIC;
+    } else if (segment->magic != CHIP8_LIVE_MAGIC || segment->version != CHIP8_LIVE_VERSION) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+void Chip8LiveExport::close() {
+    if (segment) {
+        munmap(segment, sizeof(Chip8LiveSegment));
+        segment = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool Chip8LiveExport::unlink(const char * name) {
+    return shm_unlink(name) == 0;
+}
+
+void Chip8LiveExport::publish(const Chip8 &machine) {
+    Chip8LiveState &state = segment->state;
+    unsigned int sequence = segment->sequence.load(std::memory_order_relaxed);
+
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    state.frame++;
+    state.programCounter = machine.programCounter;
+    state.indexRegister = machine.indexRegister;
+    state.stackPointer = machine.stackPointer;
+    state.delayTimer = machine.delayTimer;
+    state.soundTimer = machine.soundTimer;
+    state.fault = machine.fault;
+    memcpy(state.variableRegisters, machine.variableRegisters, sizeof(state.variableRegisters));
+    memcpy(state.keyState, machine.keyState, sizeof(state.keyState));
+    memcpy(state.stack, machine.stack, sizeof(state.stack));
+    memcpy(state.displayBuffer, machine.displayBuffer, sizeof(state.displayBuffer));
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool Chip8LiveExport::read(Chip8LiveState &out) const {
+    if (segment->magic != CHIP8_LIVE_MAGIC || segment->version != CHIP8_LIVE_VERSION) {
+        return false;
+    }
+
+    for (;;) {
+        unsigned int before = segment->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        memcpy(&out, &segment->state, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (segment->sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+}
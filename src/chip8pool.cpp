@@ -0,0 +1,64 @@
+#include "chip8pool.hpp"
+#include <new>
+#include <sys/mman.h>
+
+#define GIB (1024.0 * 1024.0 * 1024.0)
+
+Chip8Pool::Chip8Pool(int count) {
+    machineCount = count;
+    mappedBytes = sizeof(Chip8) * count;
+
+    void * block = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(block, mappedBytes, MADV_HUGEPAGE);
+#endif
+
+    machines = (Chip8 *) block;
+    for (int i = 0; i < count; i++) {
+        ::new (&machines[i]) Chip8();
+    }
+}
+
+Chip8Pool::~Chip8Pool() {
+    for (int i = 0; i < machineCount; i++) {
+        machines[i].~Chip8();
+    }
+    munmap(machines, mappedBytes);
+}
+
+void Chip8Pool::resetAll(const Chip8Snapshot &snap) {
+    for (int i = 0; i < machineCount; i++) {
+        machines[i].resetTo(snap);
+    }
+}
+
+void printLayoutReport(std::ostream &out) {
+    size_t batchLane = CHIP8_RAM_BYTES + sizeof(qword) * CHIP8_SCREEN_HEIGHT + 16    // RAM, display, keys
+        + CHIP8_VARIABLE_REGISTERS + sizeof(word) * CHIP8_STACK_HEIGHT              // V, stack
+        + 1 + 2 * sizeof(word) + 2                                                  // SP, PC, I, timers
+        + 6;                                                                        // flags
+    size_t snapshotFixed = sizeof(Chip8Snapshot);
+
+    out << "Chip8" << std::endl;
+    out << "  sizeof:            " << sizeof(Chip8) << std::endl;
+    out << "  alignof:           " << alignof(Chip8) << std::endl;
+    out << "  programCounter:    +" << offsetof(Chip8, programCounter) << std::endl;
+    out << "  variableRegisters: +" << offsetof(Chip8, variableRegisters) << std::endl;
+    out << "  keyState:          +" << offsetof(Chip8, keyState) << std::endl;
+    out << "  fault:             +" << offsetof(Chip8, fault) << std::endl;
+    out << "  stack:             +" << offsetof(Chip8, stack) << std::endl;
+    out << "  displayBuffer:     +" << offsetof(Chip8, displayBuffer) << std::endl;
+    out << "  ram:               +" << offsetof(Chip8, ram) << std::endl;
+    out << "  per GiB (pool):    " << (long) (GIB / sizeof(Chip8)) << std::endl;
+
+    out << "Chip8Batch" << std::endl;
+    out << "  bytes per lane:    " << batchLane << std::endl;
+    out << "  per GiB:           " << (long) (GIB / batchLane) << std::endl;
+
+    out << "Chip8Snapshot" << std::endl;
+    out << "  sizeof:            " << snapshotFixed << " + shared pages of " << sizeof(Chip8Page) << std::endl;
+    out << "  per GiB (RAM shared): " << (long) (GIB / snapshotFixed) << std::endl;
+}
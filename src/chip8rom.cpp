@@ -0,0 +1,380 @@
+#include "chip8rom.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(CHIP8_ROM_BYTES <= 4096, "A ROM must fit in one page so the mapping is zero-padded");
+
+Chip8Rom::Chip8Rom() {
+    mapped = nullptr;
+    fileBytes = 0;
+    contentHash = 0;
+}
+
+Chip8Rom::~Chip8Rom() {
+    close();
+}
+
+bool Chip8Rom::open(const char * path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        errno = errno ? errno : EINVAL;
+        return false;
+    }
+
+    void * map = mmap(nullptr, CHIP8_ROM_BYTES, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    mapped = (byte *) map;
+    fileBytes = info.st_size < CHIP8_ROM_BYTES ? info.st_size : CHIP8_ROM_BYTES;
+
+    contentHash = 14695981039346656037UL;
+    for (int i = 0; i < fileBytes; i++) {
+        contentHash = (contentHash ^ mapped[i]) * 1099511628211UL;
+    }
+    return true;
+}
+
+void Chip8Rom::close() {
+    if (mapped) {
+        munmap(mapped, CHIP8_ROM_BYTES);
+        mapped = nullptr;
+    }
+    fileBytes = 0;
+}
+
+// How control leaves an instruction, mirroring Chip8::execute()
+static Chip8BlockExit exitOf(word opcode) {
+    switch (opcode & 0xF000) {
+        case 0x0000:    return (opcode & 0xF) == 0xE ? CHIP8_EXIT_RETURN : CHIP8_EXIT_FALLTHROUGH;
+        case 0x1000:    return CHIP8_EXIT_JUMP;
+        case 0x2000:    return CHIP8_EXIT_CALL;
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:    return CHIP8_EXIT_SKIP;
+        case 0xB000:    return CHIP8_EXIT_BAD;
+        case 0xE000:
+            return ((opcode & 0xF) == 0xE || (opcode & 0xF) == 0x1) ? CHIP8_EXIT_SKIP : CHIP8_EXIT_FALLTHROUGH;
+    }
+    return CHIP8_EXIT_FALLTHROUGH;
+}
+
+Chip8RomAnalysis::Chip8RomAnalysis() {
+    hash = 0;
+    quirks = 0;
+    memset(spinSites, 0, sizeof(spinSites));
+}
+
+void Chip8RomAnalysis::analyze(const Chip8Rom &rom) {
+    byte ram[CHIP8_RAM_BYTES] = {};
+    bool reachable[CHIP8_RAM_BYTES] = {};
+    bool leader[CHIP8_RAM_BYTES] = {};
+
+    memcpy(ram + 512, rom.data(), CHIP8_ROM_BYTES);
+    hash = rom.hash();
+    blocks.clear();
+    instructions.clear();
+    idleSites.clear();
+    quirks = 0;
+
+    // Walk every path from the entry point, marking where blocks must start
+    std::vector<word> work(1, 0x200);
+    leader[0x200] = true;
+
+    while (!work.empty()) {
+        word address = work.back();
+        work.pop_back();
+
+        while (address + 1 < CHIP8_RAM_BYTES && !reachable[address]) {
+            reachable[address] = true;
+            word opcode = combine(ram[address], ram[address + 1]);
+            word NNN = opcode & 0x0FFF;
+            Chip8BlockExit exit = exitOf(opcode);
+
+            if (exit == CHIP8_EXIT_JUMP || exit == CHIP8_EXIT_CALL) {
+                leader[NNN] = true;
+                work.push_back(NNN);
+            }
+            if (exit == CHIP8_EXIT_SKIP) {
+                leader[(address + 4) % CHIP8_RAM_BYTES] = true;
+                work.push_back(address + 4);
+            }
+            if (exit == CHIP8_EXIT_CALL || exit == CHIP8_EXIT_SKIP) {
+                leader[(address + 2) % CHIP8_RAM_BYTES] = true;
+            }
+            if (exit == CHIP8_EXIT_JUMP || exit == CHIP8_EXIT_RETURN || exit == CHIP8_EXIT_BAD) {
+                break;
+            }
+
+            address += 2;
+
+            // Falling into code another path already walked
+            if (address < CHIP8_RAM_BYTES && reachable[address]) {
+                leader[address] = true;
+            }
+        }
+    }
+
+    // Cut reachable code into blocks and decode it
+    for (int address = 0; address + 1 < CHIP8_RAM_BYTES; ) {
+        if (!reachable[address]) {
+            address++;
+            continue;
+        }
+
+        Chip8BasicBlock block;
+        block.start = address;
+
+        for (;;) {
+            word opcode = combine(ram[address], ram[address + 1]);
+            Chip8Decoded decoded = {
+                (word) address, opcode,
+                (byte) ((opcode >> 8) & 0xF), (byte) ((opcode >> 4) & 0xF), (byte) (opcode & 0xF),
+                (byte) (opcode & 0xFF), (word) (opcode & 0xFFF)
+            };
+            instructions.push_back(decoded);
+
+            block.exit = exitOf(opcode);
+            address += 2;
+
+            if (block.exit != CHIP8_EXIT_FALLTHROUGH) {
+                break;
+            }
+            if (address + 1 >= CHIP8_RAM_BYTES || !reachable[address]) {
+                block.exit = CHIP8_EXIT_BAD;
+                break;
+            }
+            if (leader[address]) {
+                break;
+            }
+        }
+
+        block.end = address;
+        blocks.push_back(block);
+    }
+
+    // Quirk-sensitive instructions and idle loops
+    bool writes = false;
+    bool indexIntoCode = false;
+
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Chip8Decoded &d = instructions[i];
+
+        switch (d.opcode & 0xF000) {
+            case 0x1000:
+                if (d.NNN == d.address) {
+                    Chip8IdleSite site = { d.address, CHIP8_IDLE_SPIN };
+                    idleSites.push_back(site);
+                }
+                break;
+            case 0x8000:
+                if ((d.N == 0x6 || d.N == 0xE) && d.X != d.Y) quirks |= CHIP8_QUIRK_SHIFT;
+                if (d.N >= 0x1 && d.N <= 0x3) quirks |= CHIP8_QUIRK_LOGIC_VF;
+                break;
+            case 0xA000:
+                if (d.NNN >= 0x200 && reachable[d.NNN]) indexIntoCode = true;
+                break;
+            case 0xF000:
+                if (d.NN == 0x55 || d.NN == 0x65) quirks |= CHIP8_QUIRK_LOAD_STORE;
+                if (d.NN == 0x55 || d.NN == 0x33) writes = true;
+                if (d.NN == 0x0A) {
+                    Chip8IdleSite site = { d.address, CHIP8_IDLE_KEY };
+                    idleSites.push_back(site);
+                }
+
+                // FX07; 3X00; 1NNN back to the FX07
+                if (d.NN == 0x07 && d.address + 5 < CHIP8_RAM_BYTES) {
+                    word skip = combine(ram[d.address + 2], ram[d.address + 3]);
+                    word jump = combine(ram[d.address + 4], ram[d.address + 5]);
+                    if (skip == (0x3000 | (d.X << 8)) && jump == (0x1000 | d.address)) {
+                        Chip8IdleSite site = { d.address, CHIP8_IDLE_DELAY };
+                        idleSites.push_back(site);
+                    }
+                }
+                break;
+        }
+    }
+    if (writes && indexIntoCode) {
+        quirks |= CHIP8_QUIRK_SELF_WRITE;
+    }
+
+    indexSites();
+}
+
+void Chip8RomAnalysis::indexSites() {
+    memset(spinSites, 0, sizeof(spinSites));
+    for (size_t i = 0; i < idleSites.size(); i++) {
+        if (idleSites[i].kind == CHIP8_IDLE_SPIN) {
+            word pc = idleSites[i].address;
+            spinSites[pc / 64] |= 1ULL << (pc % 64);
+        }
+    }
+}
+
+template <typename T>
+static bool writeVector(FILE * out, const std::vector<T> &items) {
+    unsigned int count = items.size();
+    return fwrite(&count, sizeof(count), 1, out) == 1
+        && fwrite(items.data(), sizeof(T), count, out) == count;
+}
+
+template <typename T>
+static bool readVector(FILE * in, std::vector<T> &items) {
+    unsigned int count;
+    if (fread(&count, sizeof(count), 1, in) != 1 || count > CHIP8_RAM_BYTES) {
+        return false;
+    }
+    items.resize(count);
+    return fread(items.data(), sizeof(T), count, in) == count;
+}
+
+// Native-endian structs: a cache directory is per machine architecture
+bool Chip8RomAnalysis::save(const std::string &path) const {
+    // Written under a unique name, then renamed, so concurrent starts never see half a file
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int) getpid());
+    std::string temp = path + suffix;
+
+    FILE * out = fopen(temp.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+
+    byte version = CHIP8_ANALYSIS_VERSION;
+    bool ok = fwrite(CHIP8_ANALYSIS_MAGIC, 1, 4, out) == 4
+        && fwrite(&version, 1, 1, out) == 1
+        && fwrite(&hash, sizeof(hash), 1, out) == 1
+        && fwrite(&quirks, sizeof(quirks), 1, out) == 1
+        && writeVector(out, blocks)
+        && writeVector(out, instructions)
+        && writeVector(out, idleSites);
+
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Chip8RomAnalysis::load(const std::string &path, unsigned long expectHash) {
+    FILE * in = fopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+
+    char magic[4];
+    byte version;
+    bool ok = fread(magic, 1, 4, in) == 4 && memcmp(magic, CHIP8_ANALYSIS_MAGIC, 4) == 0
+        && fread(&version, 1, 1, in) == 1 && version == CHIP8_ANALYSIS_VERSION
+        && fread(&hash, sizeof(hash), 1, in) == 1 && hash == expectHash
+        && fread(&quirks, sizeof(quirks), 1, in) == 1
+        && readVector(in, blocks)
+        && readVector(in, instructions)
+        && readVector(in, idleSites);
+
+    fclose(in);
+    if (!ok || !consistent()) {
+        return false;
+    }
+    indexSites();
+    return true;
+}
+
+// Every address and enum a cache entry holds is used as an index
+bool Chip8RomAnalysis::consistent() const {
+    for (size_t i = 0; i < blocks.size(); i++) {
+        const Chip8BasicBlock &block = blocks[i];
+        if (block.start >= block.end || block.end > CHIP8_RAM_BYTES || block.exit > CHIP8_EXIT_BAD) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < instructions.size(); i++) {
+        if (instructions[i].address >= CHIP8_RAM_BYTES) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < idleSites.size(); i++) {
+        if (idleSites[i].address >= CHIP8_RAM_BYTES || idleSites[i].kind > CHIP8_IDLE_KEY) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string Chip8RomAnalysis::defaultCacheDir() {
+    const char * dir = getenv("CHIP8_CACHE_DIR");
+    if (dir && *dir) {
+        return dir;
+    }
+
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir && *dir) {
+        return std::string(dir) + "/cursechip";
+    }
+
+    dir = getenv("HOME");
+    return std::string(dir ? dir : "/tmp") + "/.cache/cursechip";
+}
+
+bool Chip8RomAnalysis::loadOrAnalyze(const Chip8Rom &rom, std::string dir) {
+    if (dir.empty()) {
+        dir = defaultCacheDir();
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016lx.c8a", rom.hash());
+    std::string path = dir + name;
+
+    if (load(path, rom.hash())) {
+        return true;
+    }
+
+    analyze(rom);
+
+    // Best effort: make each missing directory level, then store
+    for (size_t slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1)) {
+        mkdir(dir.substr(0, slash).c_str(), 0755);
+        if (slash == std::string::npos) {
+            break;
+        }
+    }
+    save(path);
+    return false;
+}
+
+void Chip8RomAnalysis::print(FILE * out) const {
+    static const char * exits[] = { "fall", "jump", "call", "return", "skip", "bad" };
+    static const char * idles[] = { "spin", "delay wait", "key wait" };
+
+    fprintf(out, "hash %016lx: %zu blocks, %zu instructions, quirks", hash, blocks.size(), instructions.size());
+    if (quirks & CHIP8_QUIRK_SHIFT)         fprintf(out, " shift");
+    if (quirks & CHIP8_QUIRK_LOAD_STORE)    fprintf(out, " load-store");
+    if (quirks & CHIP8_QUIRK_LOGIC_VF)      fprintf(out, " logic-vf");
+    if (quirks & CHIP8_QUIRK_SELF_WRITE)    fprintf(out, " self-write");
+    if (!quirks)                            fprintf(out, " none");
+    fprintf(out, "\n");
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        fprintf(out, "block %03x-%03x %s\n", blocks[i].start, blocks[i].end - 2, exits[blocks[i].exit]);
+    }
+    for (size_t i = 0; i < idleSites.size(); i++) {
+        fprintf(out, "idle  %03x %s\n", idleSites[i].address, idles[idleSites[i].kind]);
+    }
+}
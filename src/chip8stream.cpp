@@ -0,0 +1,278 @@
+#include "chip8stream.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void putLong(std::vector<byte> &out, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void putRow(std::vector<byte> &out, qword row) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back((row >> shift) & 0xFF);
+    }
+}
+
+static void startMessage(std::vector<byte> &out, byte type) {
+    out.clear();
+    out.push_back(type);
+    out.push_back(0);
+    out.push_back(0);
+}
+
+static void finishMessage(std::vector<byte> &out) {
+    size_t length = out.size() - CHIP8_STREAM_HEADER_BYTES;
+    out[1] = length & 0xFF;
+    out[2] = length >> 8;
+}
+
+// Remove a socket file left by an instance that didn't exit cleanly. Anything
+// else at the path, or a socket a live server still answers on, is in use.
+static bool removeStaleSocket(const sockaddr_un &address) {
+    struct stat info;
+    if (lstat(address.sun_path, &info) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        errno = EADDRINUSE;
+        return false;
+    }
+
+    // Non-blocking, so a server with a full backlog counts as live
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        return false;
+    }
+    bool stale = connect(probe, (const sockaddr *) &address, sizeof(address)) != 0 && errno == ECONNREFUSED;
+    ::close(probe);
+
+    if (!stale) {
+        errno = EADDRINUSE;
+        return false;
+    }
+    return ::unlink(address.sun_path) == 0 || errno == ENOENT;
+}
+
+Chip8StreamServer::Chip8StreamServer() {
+    frames = 0;
+    skipped = 0;
+    dropped = 0;
+    listener = -1;
+    memset(previous, 0, sizeof(previous));
+    delta.reserve(CHIP8_STREAM_MAX_MESSAGE);
+    keyframe.reserve(CHIP8_STREAM_MAX_MESSAGE);
+}
+
+Chip8StreamServer::~Chip8StreamServer() {
+    close();
+}
+
+bool Chip8StreamServer::open(const char * socketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        return false;
+    }
+
+    if (!removeStaleSocket(address) || bind(listener, (sockaddr *) &address, sizeof(address)) != 0) {
+        ::close(listener);
+        listener = -1;
+        return false;
+    }
+
+    // Owner only, whatever the umask: a viewer watches the session and presses
+    // keys. Connects fail until listen(), so the socket is never reachable wider.
+    if (chmod(socketPath, 0600) != 0 || listen(listener, 8) != 0) {
+        int error = errno;
+        ::close(listener);
+        listener = -1;
+        ::unlink(socketPath);
+        errno = error;
+        return false;
+    }
+
+    path = socketPath;
+    return true;
+}
+
+void Chip8StreamServer::close() {
+    while (!viewers.empty()) {
+        disconnect(viewers.size() - 1);
+    }
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(path.c_str());
+        listener = -1;
+    }
+}
+
+void Chip8StreamServer::disconnect(size_t index) {
+    ::close(viewers[index].fd);
+    viewers[index] = viewers.back();
+    viewers.pop_back();
+}
+
+// False if the viewer has gone away
+bool Chip8StreamServer::flush(Viewer &viewer) {
+    while (viewer.sent < viewer.pending.size()) {
+        ssize_t n = send(viewer.fd, viewer.pending.data() + viewer.sent, viewer.pending.size() - viewer.sent,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        viewer.sent += n;
+    }
+    viewer.pending.clear();
+    viewer.sent = 0;
+    return true;
+}
+
+int Chip8StreamServer::poll(Chip8StreamKey * keys, int max) {
+    if (listener < 0) {
+        return 0;
+    }
+
+    for (;;) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            break;
+        }
+        if (viewers.size() >= CHIP8_STREAM_MAX_VIEWERS) {
+            ::close(fd);
+            continue;
+        }
+
+        Viewer viewer;
+        viewer.fd = fd;
+        viewer.pending.assign(CHIP8_STREAM_MAGIC, CHIP8_STREAM_MAGIC + 4);
+        viewer.pending.push_back(CHIP8_STREAM_VERSION);
+        viewer.sent = 0;
+        viewer.needKeyframe = true;
+        viewer.behind = 0;
+        viewers.push_back(viewer);
+    }
+
+    int count = 0;
+    for (size_t i = 0; i < viewers.size(); ) {
+        Viewer &viewer = viewers[i];
+        bool alive = flush(viewer);
+
+        byte events[64];
+        ssize_t n = -1;
+        while (alive && count < max
+                && (n = recv(viewer.fd, events, std::min<size_t>(sizeof(events), max - count), MSG_DONTWAIT)) != 0) {
+            if (n < 0) {
+                alive = errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                break;
+            }
+            for (ssize_t e = 0; e < n && count < max; e++) {
+                keys[count].key = events[e] & 0xF;
+                keys[count].down = events[e] & CHIP8_STREAM_KEY_DOWN;
+                count++;
+            }
+        }
+
+        // recv returning 0 is a viewer that hung up
+        if (!alive || n == 0) {
+            disconnect(i);
+        } else {
+            i++;
+        }
+    }
+    return count;
+}
+
+bool Chip8StreamServer::waiting() const {
+    for (size_t i = 0; i < viewers.size(); i++) {
+        if (viewers[i].needKeyframe && viewers[i].pending.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Chip8StreamServer::frame(const Chip8 &machine) {
+    if (viewers.empty()) {
+        memcpy(previous, machine.displayBuffer, sizeof(previous));
+        return;
+    }
+
+    unsigned int changed = 0;
+    for (int row = 0; row < CHIP8_SCREEN_HEIGHT; row++) {
+        if (machine.displayBuffer[row] != previous[row]) {
+            changed |= 1U << row;
+        }
+    }
+
+    startMessage(delta, CHIP8_STREAM_DELTA);
+    putLong(delta, frames);
+    putLong(delta, changed);
+    for (int row = 0; row < CHIP8_SCREEN_HEIGHT; row++) {
+        if ((changed >> row) & 1) {
+            putRow(delta, machine.displayBuffer[row]);
+        }
+    }
+    finishMessage(delta);
+    keyframe.clear();
+
+    for (size_t i = 0; i < viewers.size(); ) {
+        Viewer &viewer = viewers[i];
+
+        // Still sending an earlier frame: skip this one, and resync later
+        if (!viewer.pending.empty() && !flush(viewer)) {
+            disconnect(i);
+            continue;
+        }
+        if (!viewer.pending.empty()) {
+            skipped++;
+            viewer.needKeyframe = true;
+            if (++viewer.behind >= CHIP8_STREAM_DROP_FRAMES) {
+                dropped++;
+                disconnect(i);
+                continue;
+            }
+            i++;
+            continue;
+        }
+
+        // Deltas only apply on top of the frame before, so a viewer that missed one gets every row
+        const std::vector<byte> * message = &delta;
+        if (viewer.needKeyframe) {
+            if (keyframe.empty()) {
+                startMessage(keyframe, CHIP8_STREAM_KEYFRAME);
+                putLong(keyframe, frames);
+                for (int row = 0; row < CHIP8_SCREEN_HEIGHT; row++) {
+                    putRow(keyframe, machine.displayBuffer[row]);
+                }
+                finishMessage(keyframe);
+            }
+            message = &keyframe;
+            viewer.needKeyframe = false;
+        }
+
+        viewer.behind = 0;
+        viewer.pending.insert(viewer.pending.end(), message->begin(), message->end());
+        if (!flush(viewer)) {
+            disconnect(i);
+            continue;
+        }
+        i++;
+    }
+
+    memcpy(previous, machine.displayBuffer, sizeof(previous));
+    frames++;
+}
@@ -0,0 +1,491 @@
+#include "chip8trace.hpp"
+#include <cstring>
+#ifdef CHIP8_ZLIB
+#include <zlib.h>
+#endif
+
+static void putVarint(std::vector<byte> &out, unsigned int value) {
+    while (value >= 0x80) {
+        out.push_back((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(value);
+}
+
+static void putZigzag(std::vector<byte> &out, int value) {
+    putVarint(out, ((unsigned int) value << 1) ^ (unsigned int) (value >> 31));
+}
+
+// Readers stop at end and return false rather than run past it
+static bool getVarint(const byte *&in, const byte * end, unsigned int &value) {
+    value = 0;
+    for (int shift = 0; shift < 32 && in < end; shift += 7) {
+        byte b = *in++;
+        value |= (unsigned int) (b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool getZigzag(const byte *&in, const byte * end, int &value) {
+    unsigned int zigzag;
+    if (!getVarint(in, end, zigzag)) {
+        return false;
+    }
+    value = (int) (zigzag >> 1) ^ -(int) (zigzag & 1);
+    return true;
+}
+
+static bool getWord(const byte *&in, const byte * end, word &value) {
+    if (end - in < 2) {
+        return false;
+    }
+    value = (in[0] << 8) | in[1];
+    in += 2;
+    return true;
+}
+
+static bool getBytes(const byte *&in, const byte * end, byte * out, size_t count) {
+    if ((size_t) (end - in) < count) {
+        return false;
+    }
+    memcpy(out, in, count);
+    in += count;
+    return true;
+}
+
+static void putWord(std::vector<byte> &out, word value) {
+    out.push_back(value >> 8);
+    out.push_back(value & 0xFF);
+}
+
+static void putLong(byte * out, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static unsigned int getLong(const byte * in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((unsigned int) in[3] << 24);
+}
+
+Chip8Tracer::Chip8Tracer(Chip8 &machine) : machine(machine) {
+    records = 0;
+    stalls = 0;
+    out = nullptr;
+    lastPc = 0;
+    needSync = true;
+    stopping = false;
+}
+
+Chip8Tracer::~Chip8Tracer() {
+    close();
+}
+
+bool Chip8Tracer::open(const char * path) {
+    out = fopen(path, "wb");
+    if (!out) {
+        return false;
+    }
+
+    fwrite(CHIP8_TRACE_MAGIC, 1, 4, out);
+    fputc(CHIP8_TRACE_VERSION, out);
+
+    block.reserve(CHIP8_TRACE_BLOCK_BYTES);
+    needSync = true;
+    stopping = false;
+    writer = std::thread(&Chip8Tracer::writeBlocks, this);
+    return true;
+}
+
+void Chip8Tracer::close() {
+    if (!out) {
+        return;
+    }
+    if (!block.empty()) {
+        submitBlock();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    fclose(out);
+    out = nullptr;
+}
+
+void Chip8Tracer::writeSync() {
+    block.push_back(CHIP8_TRACE_SYNC);
+    putWord(block, machine.programCounter);
+    putWord(block, machine.indexRegister);
+    block.insert(block.end(), machine.variableRegisters, machine.variableRegisters + CHIP8_VARIABLE_REGISTERS);
+    block.push_back(machine.stackPointer);
+    block.push_back(machine.delayTimer);
+    block.push_back(machine.soundTimer);
+
+    lastPc = machine.programCounter - 2;
+    needSync = false;
+}
+
+void Chip8Tracer::step() {
+    if (machine.fault) {
+        return;
+    }
+    if (needSync) {
+        writeSync();
+    }
+
+    // Everything an instruction can change outside RAM and the display
+    word pc = machine.programCounter;
+    word I = machine.indexRegister;
+    byte registers[CHIP8_VARIABLE_REGISTERS];
+    memcpy(registers, machine.variableRegisters, sizeof(registers));
+    byte sp = machine.stackPointer;
+    byte dt = machine.delayTimer;
+    byte st = machine.soundTimer;
+    word opcode = pc + 1 < CHIP8_RAM_BYTES ? combine(machine.ram[pc], machine.ram[pc + 1]) : 0;
+
+    machine.cycle();
+
+    byte flags = 0;
+    size_t head = block.size();
+    block.push_back(0);
+    putWord(block, opcode);
+
+    if (pc != (word) (lastPc + 2)) {
+        flags |= CHIP8_TRACE_JUMP;
+        putZigzag(block, (int) pc - (int) (word) (lastPc + 2));
+    }
+    lastPc = pc;
+
+    if (machine.indexRegister != I) {
+        flags |= CHIP8_TRACE_INDEX;
+        putZigzag(block, (int) machine.indexRegister - (int) I);
+    }
+
+    word mask = 0;
+    for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
+        if (machine.variableRegisters[i] != registers[i]) {
+            mask |= 1 << i;
+        }
+    }
+    if (mask) {
+        flags |= CHIP8_TRACE_REGISTERS;
+        putVarint(block, mask);
+        for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
+            if ((mask >> i) & 1) {
+                block.push_back(machine.variableRegisters[i]);
+            }
+        }
+    }
+
+    if (machine.stackPointer != sp) {
+        flags |= CHIP8_TRACE_STACK;
+        block.push_back(machine.stackPointer);
+    }
+
+    if (machine.delayTimer != (dt ? dt - 1 : 0) || machine.soundTimer != (st ? st - 1 : 0)) {
+        flags |= CHIP8_TRACE_TIMERS;
+        block.push_back(machine.delayTimer);
+        block.push_back(machine.soundTimer);
+    }
+
+    // Only FX33 and FX55 write RAM, and only when they didn't fault
+    int length = 0;
+    if ((opcode & 0xF0FF) == 0xF033) {
+        length = 3;
+    } else if ((opcode & 0xF0FF) == 0xF055) {
+        length = ((opcode >> 8) & 0xF) + 1;
+    }
+    if (length && !machine.fault) {
+        flags |= CHIP8_TRACE_WRITE;
+        putVarint(block, I);
+        block.push_back(length);
+        block.insert(block.end(), machine.ram + I, machine.ram + I + length);
+    }
+
+    if (machine.fault) {
+        flags |= CHIP8_TRACE_FAULT;
+        block.push_back(machine.fault);
+    }
+
+    block[head] = flags;
+    records++;
+
+    if (block.size() + CHIP8_TRACE_MAX_RECORD > CHIP8_TRACE_BLOCK_BYTES) {
+        submitBlock();
+    }
+}
+
+void Chip8Tracer::run(int cycles) {
+    for (int i = 0; i < cycles && !machine.fault; i++) {
+        step();
+    }
+}
+
+void Chip8Tracer::submitBlock() {
+    std::vector<byte> next;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (queue.size() >= CHIP8_TRACE_QUEUE_BLOCKS) {
+            stalls++;
+            while (queue.size() >= CHIP8_TRACE_QUEUE_BLOCKS) {
+                changed.wait(guard);
+            }
+        }
+        queue.push_back(std::vector<byte>());
+        queue.back().swap(block);
+        if (!spare.empty()) {
+            next.swap(spare.back());
+            spare.pop_back();
+        }
+    }
+    changed.notify_all();
+
+    next.clear();
+    next.reserve(CHIP8_TRACE_BLOCK_BYTES);
+    block.swap(next);
+    needSync = true;
+}
+
+void Chip8Tracer::writeBlocks() {
+    std::vector<byte> raw;
+    std::vector<byte> packed;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (queue.empty() && !stopping) {
+                changed.wait(guard);
+            }
+            if (queue.empty()) {
+                return;
+            }
+            raw.swap(queue.front());
+            queue.pop_front();
+        }
+        changed.notify_all();
+
+        byte method = CHIP8_TRACE_STORED;
+        const byte * data = raw.data();
+        size_t size = raw.size();
+
+#ifdef CHIP8_ZLIB
+        uLongf packedSize = compressBound(raw.size());
+        packed.resize(packedSize);
+        if (compress2(packed.data(), &packedSize, raw.data(), raw.size(), 1) == Z_OK) {
+            method = CHIP8_TRACE_ZLIB;
+            data = packed.data();
+            size = packedSize;
+        }
+#endif
+
+        byte header[9];
+        putLong(header, raw.size());
+        putLong(header + 4, size);
+        header[8] = method;
+        fwrite(header, 1, sizeof(header), out);
+        fwrite(data, 1, size, out);
+
+        // Hand the buffer back so step() doesn't allocate
+        std::lock_guard<std::mutex> guard(lock);
+        spare.push_back(std::vector<byte>());
+        spare.back().swap(raw);
+    }
+}
+
+Chip8TraceReader::Chip8TraceReader() {
+    in = nullptr;
+    pos = 0;
+    damaged = false;
+    memset(&state, 0, sizeof(state));
+}
+
+Chip8TraceReader::~Chip8TraceReader() {
+    close();
+}
+
+bool Chip8TraceReader::open(const char * path) {
+    in = fopen(path, "rb");
+    if (!in) {
+        return false;
+    }
+
+    char magic[5];
+    if (fread(magic, 1, 5, in) != 5 || memcmp(magic, CHIP8_TRACE_MAGIC, 4) != 0 || magic[4] != CHIP8_TRACE_VERSION) {
+        close();
+        return false;
+    }
+
+    raw.clear();
+    pos = 0;
+    damaged = false;
+    memset(&state, 0, sizeof(state));
+    return true;
+}
+
+void Chip8TraceReader::close() {
+    if (in) {
+        fclose(in);
+        in = nullptr;
+    }
+}
+
+bool Chip8TraceReader::readBlock() {
+    byte header[9];
+    if (!in) {
+        return false;
+    }
+    size_t got = fread(header, 1, sizeof(header), in);
+    if (got != sizeof(header)) {
+        // Nothing at all is the clean end of the trace
+        return got ? corrupt() : false;
+    }
+
+    // No writer makes a bigger block, and zlib never doubles one
+    unsigned int rawSize = getLong(header);
+    unsigned int storedSize = getLong(header + 4);
+    if (rawSize > CHIP8_TRACE_BLOCK_BYTES || storedSize > 2 * CHIP8_TRACE_BLOCK_BYTES) {
+        return corrupt();
+    }
+    stored.resize(storedSize);
+    if (fread(stored.data(), 1, storedSize, in) != storedSize) {
+        return corrupt();
+    }
+
+    if (header[8] == CHIP8_TRACE_STORED) {
+        raw.swap(stored);
+#ifdef CHIP8_ZLIB
+    } else if (header[8] == CHIP8_TRACE_ZLIB) {
+        uLongf size = rawSize;
+        raw.resize(rawSize);
+        if (uncompress(raw.data(), &size, stored.data(), storedSize) != Z_OK || size != rawSize) {
+            return corrupt();
+        }
+#endif
+    } else {
+        return corrupt();
+    }
+
+    if (raw.size() != rawSize) {
+        return corrupt();
+    }
+    pos = 0;
+    return true;
+}
+
+bool Chip8TraceReader::next(Chip8TraceRecord &record) {
+    while (pos >= raw.size()) {
+        if (!readBlock()) {
+            return false;
+        }
+    }
+
+    const byte * p = raw.data() + pos;
+    const byte * end = raw.data() + raw.size();
+    byte flags = *p++;
+
+    if (flags == CHIP8_TRACE_SYNC) {
+        word pc;
+        byte timers[3];
+        if (!getWord(p, end, pc) || !getWord(p, end, state.indexRegister)
+            || !getBytes(p, end, state.variableRegisters, CHIP8_VARIABLE_REGISTERS)
+            || !getBytes(p, end, timers, sizeof(timers))) {
+            return corrupt();
+        }
+        state.programCounter = pc - 2;
+        state.stackPointer = timers[0];
+        state.delayTimer = timers[1];
+        state.soundTimer = timers[2];
+        pos = p - raw.data();
+        return next(record);
+    }
+
+    state.flags = flags;
+    if (!getWord(p, end, state.opcode)) {
+        return corrupt();
+    }
+    state.programCounter += 2;
+    if (flags & CHIP8_TRACE_JUMP) {
+        int delta;
+        if (!getZigzag(p, end, delta)) {
+            return corrupt();
+        }
+        state.programCounter += delta;
+    }
+    if (flags & CHIP8_TRACE_INDEX) {
+        int delta;
+        if (!getZigzag(p, end, delta)) {
+            return corrupt();
+        }
+        state.indexRegister += delta;
+    }
+
+    state.changedRegisters = 0;
+    if (flags & CHIP8_TRACE_REGISTERS) {
+        unsigned int mask;
+        if (!getVarint(p, end, mask) || mask >> CHIP8_VARIABLE_REGISTERS) {
+            return corrupt();
+        }
+        state.changedRegisters = mask;
+        for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
+            if (((mask >> i) & 1) && !getBytes(p, end, &state.variableRegisters[i], 1)) {
+                return corrupt();
+            }
+        }
+    }
+
+    if ((flags & CHIP8_TRACE_STACK) && !getBytes(p, end, &state.stackPointer, 1)) {
+        return corrupt();
+    }
+
+    if (flags & CHIP8_TRACE_TIMERS) {
+        if (!getBytes(p, end, &state.delayTimer, 1) || !getBytes(p, end, &state.soundTimer, 1)) {
+            return corrupt();
+        }
+    } else {
+        state.delayTimer -= state.delayTimer > 0;
+        state.soundTimer -= state.soundTimer > 0;
+    }
+
+    state.writeLength = 0;
+    if (flags & CHIP8_TRACE_WRITE) {
+        unsigned int address;
+        byte length;
+        // Writes that would leave RAM fault instead, so are never recorded
+        if (!getVarint(p, end, address) || !getBytes(p, end, &length, 1)
+            || length > CHIP8_VARIABLE_REGISTERS || address > (unsigned int) CHIP8_RAM_BYTES - length
+            || !getBytes(p, end, state.written, length)) {
+            return corrupt();
+        }
+        state.writeAddress = address;
+        state.writeLength = length;
+    }
+
+    state.fault = CHIP8_FAULT_NONE;
+    if (flags & CHIP8_TRACE_FAULT) {
+        byte fault;
+        if (!getBytes(p, end, &fault, 1) || fault > CHIP8_FAULT_BAD_KEY) {
+            return corrupt();
+        }
+        state.fault = (Chip8Fault) fault;
+    }
+
+    pos = p - raw.data();
+    record = state;
+    state.index++;
+    return true;
+}
+
+bool Chip8TraceReader::corrupt() {
+    damaged = true;
+    raw.clear();
+    pos = 0;
+    close();
+    return false;
+}
@@ -0,0 +1,297 @@
+#include "chip8.hpp"
+#include "chip8rom.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define EXPLORE_EDGE_BITS           16
+#define EXPLORE_EDGE_WORDS          ((1 << EXPLORE_EDGE_BITS) / 64)
+#define EXPLORE_PC_WORDS            (CHIP8_RAM_BYTES / 64)
+#define EXPLORE_CYCLES_PER_INPUT    100
+#define EXPLORE_INPUTS_PER_RUN      16
+#define EXPLORE_MAX_INPUTS          4096
+
+typedef unsigned long long bitmap_word;
+
+// A machine that reached new coverage, and the key masks that got it there
+struct corpus_entry {
+    Chip8Snapshot snap;
+    std::vector<word> inputs;
+};
+
+struct run_coverage {
+    bitmap_word pcs[EXPLORE_PC_WORDS];
+    bitmap_word edges[EXPLORE_EDGE_WORDS];
+};
+
+struct explorer {
+    std::atomic<bitmap_word> pcs[EXPLORE_PC_WORDS];
+    std::atomic<bitmap_word> edges[EXPLORE_EDGE_WORDS];
+    std::atomic<unsigned long> execs;
+    std::atomic<int> pcCount;
+    std::atomic<int> edgeCount;
+    std::atomic<bool> stop;
+
+    std::mutex lock;
+    std::vector<std::shared_ptr<const corpus_entry>> corpus;
+    std::vector<std::shared_ptr<const corpus_entry>> growable;  // Entries shorter than EXPLORE_MAX_INPUTS
+    std::set<std::pair<int, int>> crashes;
+    std::string outDir;
+};
+
+// Hold the keys in mask, feeding FX0A like the frontend does for new presses
+void press_keys(Chip8 &m, word mask) {
+    for (int key = 0; key < 16; key++) {
+        bool down = (mask >> key) & 1;
+
+        if (down && !m.keyState[key]) {
+            if (m.blockingForKey) {
+                m.lastKeyFromBlock = true;
+            }
+            m.lastKey = key;
+        }
+        m.keyState[key] = down;
+    }
+}
+
+unsigned int next_random(unsigned int &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+word mutate_mask(word mask, unsigned int &rng) {
+    unsigned int roll = next_random(rng) % 10;
+
+    if (roll < 4) {
+        return mask;
+    } else if (roll < 7) {
+        return mask ^ (1 << (next_random(rng) % 16));
+    } else if (roll < 9) {
+        return 1 << (next_random(rng) % 16);
+    }
+    return 0;
+}
+
+// Fold one run into the global maps; true if it covered anything new
+bool merge_coverage(explorer &ex, const run_coverage &run) {
+    int newPcs = 0;
+    int newEdges = 0;
+
+    for (int i = 0; i < EXPLORE_PC_WORDS; i++) {
+        if (run.pcs[i] & ~ex.pcs[i].load(std::memory_order_relaxed)) {
+            bitmap_word old = ex.pcs[i].fetch_or(run.pcs[i]);
+            newPcs += __builtin_popcountll(run.pcs[i] & ~old);
+        }
+    }
+    for (int i = 0; i < EXPLORE_EDGE_WORDS; i++) {
+        if (run.edges[i] & ~ex.edges[i].load(std::memory_order_relaxed)) {
+            bitmap_word old = ex.edges[i].fetch_or(run.edges[i]);
+            newEdges += __builtin_popcountll(run.edges[i] & ~old);
+        }
+    }
+
+    ex.pcCount += newPcs;
+    ex.edgeCount += newEdges;
+    return newPcs || newEdges;
+}
+
+void write_keys(const std::string &path, const std::vector<word> &inputs) {
+    FILE * out = fopen(path.c_str(), "w");
+    if (!out) {
+        return;
+    }
+    fprintf(out, "# one key mask per line, each held for %d cycles\n", EXPLORE_CYCLES_PER_INPUT);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        fprintf(out, "%04x\n", inputs[i]);
+    }
+    fclose(out);
+}
+
+void report_crash(explorer &ex, const Chip8 &m, const std::vector<word> &inputs) {
+    std::lock_guard<std::mutex> guard(ex.lock);
+
+    if (!ex.crashes.insert(std::make_pair((int) m.fault, (int) m.programCounter)).second) {
+        return;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/crash-%03x-%d.keys", m.programCounter, (int) m.fault);
+    write_keys(ex.outDir + name, inputs);
+
+    fprintf(stderr, "crash: %s at %03x after %zu inputs -> %s%s\n",
+        faultName(m.fault), m.programCounter, inputs.size(), ex.outDir.c_str(), name);
+}
+
+void explore_worker(explorer &ex, unsigned int seed) {
+    Chip8 m;
+    run_coverage run;
+    unsigned int rng = seed | 1;
+
+    while (!ex.stop) {
+        std::shared_ptr<const corpus_entry> parent;
+        {
+            // Only entries that can still grow, so no pick is wasted; the seed always can
+            std::lock_guard<std::mutex> guard(ex.lock);
+            parent = ex.growable[next_random(rng) % ex.growable.size()];
+        }
+
+        m.resetTo(parent->snap);
+        memset(&run, 0, sizeof(run));
+
+        std::vector<word> inputs = parent->inputs;
+        word mask = inputs.empty() ? 0 : inputs.back();
+        word prev = m.programCounter;
+
+        for (int k = 0; k < EXPLORE_INPUTS_PER_RUN && !m.fault; k++) {
+            mask = mutate_mask(mask, rng);
+            inputs.push_back(mask);
+            press_keys(m, mask);
+
+            for (int c = 0; c < EXPLORE_CYCLES_PER_INPUT; c++) {
+                word pc = m.programCounter % CHIP8_RAM_BYTES;
+                int edge = ((prev >> 1) ^ (pc << 3)) & ((1 << EXPLORE_EDGE_BITS) - 1);
+
+                run.pcs[pc / 64] |= 1ULL << (pc % 64);
+                run.edges[edge / 64] |= 1ULL << (edge % 64);
+                prev = pc;
+
+                m.cycle();
+                if (m.fault) {
+                    break;
+                }
+            }
+        }
+        ex.execs++;
+
+        bool fresh = merge_coverage(ex, run);
+
+        if (m.fault) {
+            report_crash(ex, m, inputs);
+        } else if (fresh) {
+            corpus_entry * entry = new corpus_entry;
+            entry->snap = m.snapshot(&parent->snap);
+            entry->inputs.swap(inputs);
+
+            std::shared_ptr<const corpus_entry> shared(entry);
+            std::lock_guard<std::mutex> guard(ex.lock);
+            ex.corpus.push_back(shared);
+            if (shared->inputs.size() < EXPLORE_MAX_INPUTS) {
+                ex.growable.push_back(shared);
+            }
+        }
+    }
+}
+
+int replay(const byte * rom, const std::string &keysFile) {
+    Chip8 m;
+    m.load(rom);
+
+    std::ifstream in(keysFile);
+    std::string line;
+    int count = 0;
+
+    while (std::getline(in, line) && !m.fault) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        press_keys(m, strtoul(line.c_str(), nullptr, 16));
+        count++;
+
+        for (int c = 0; c < EXPLORE_CYCLES_PER_INPUT && !m.fault; c++) {
+            m.cycle();
+        }
+    }
+
+    if (m.fault) {
+        printf("%s at %03x after %d inputs\n", faultName(m.fault), m.programCounter, count);
+        return 1;
+    }
+    printf("no fault after %d inputs\n", count);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        std::cout << "Usage: ./chip8-explore filename.rom [--threads N] [--seconds N] [--out dir]" << std::endl;
+        std::cout << "       ./chip8-explore filename.rom --replay crash.keys" << std::endl;
+        exit(1);
+    }
+
+    int threads = std::thread::hardware_concurrency();
+    int seconds = 60;
+    std::string outDir = ".";
+    std::string replayFile;
+
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+
+        if (flag == "--threads")        threads = atoi(argv[i + 1]);
+        else if (flag == "--seconds")   seconds = atoi(argv[i + 1]);
+        else if (flag == "--out")       outDir = argv[i + 1];
+        else if (flag == "--replay")    replayFile = argv[i + 1];
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    Chip8Rom rom;
+    if (!rom.open(argv[1])) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        exit(1);
+    }
+
+    if (!replayFile.empty()) {
+        return replay(rom.data(), replayFile);
+    }
+
+    explorer * ex = new explorer();
+    ex->outDir = outDir;
+
+    // Seed the corpus with the freshly loaded machine
+    Chip8 start;
+    start.load(rom.data());
+    rom.close();
+    corpus_entry * seed = new corpus_entry;
+    seed->snap = start.snapshot();
+    ex->corpus.push_back(std::shared_ptr<const corpus_entry>(seed));
+    ex->growable.push_back(ex->corpus.back());
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(std::thread(explore_worker, std::ref(*ex), 0x9E3779B9u * (i + 1)));
+    }
+
+    for (int elapsed = 1; elapsed <= seconds; elapsed++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        size_t corpusSize, crashCount;
+        {
+            std::lock_guard<std::mutex> guard(ex->lock);
+            corpusSize = ex->corpus.size();
+            crashCount = ex->crashes.size();
+        }
+        fprintf(stderr, "[%4ds] execs: %lu corpus: %zu pcs: %d edges: %d crashes: %zu\n",
+            elapsed, ex->execs.load(), corpusSize, ex->pcCount.load(), ex->edgeCount.load(), crashCount);
+    }
+
+    ex->stop = true;
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    return ex->crashes.empty() ? 0 : 2;
+}
@@ -0,0 +1,557 @@
+#include "frontend.hpp"
+#include <iostream>
+#include <string>
+#include <ctime>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+void init_curses() {
+    initscr();
+    cbreak();
+    keypad(stdscr, TRUE);
+    noecho();
+    nodelay(stdscr, TRUE);
+    
+    // Set up terminal colours
+    if (has_colors() == FALSE) {
+        endwin();
+		printf("Your terminal does not support color\n");
+		exit(1);
+	}
+
+    // start_color();
+    init_pair(1, COLOR_BLUE, COLOR_BLACK);
+    init_pair(2, COLOR_BLACK, COLOR_GREEN);
+
+    refresh();
+}
+
+// Instance index of a columns x rows grid of tiles, with the shared help bar below
+frontend_layout instance_layout(int index, int columns, int rows) {
+    frontend_layout layout;
+    int x = (index % columns) * FRONTEND_TILE_WIDTH;
+    int y = (index / columns) * FRONTEND_TILE_HEIGHT;
+
+    layout.screen_x = x + FRONTEND_SCREEN_X;
+    layout.screen_y = y + FRONTEND_SCREEN_Y;
+    layout.sidebar_x = x + FRONTEND_SIDEBAR_X;
+    layout.sidebar_y = y + FRONTEND_SIDEBAR_Y;
+    layout.helpbar_x = FRONTEND_HELPBAR_X;
+    layout.helpbar_y = FRONTEND_HELPBAR_Y + (rows - 1) * FRONTEND_TILE_HEIGHT;
+    layout.metrics_x = FRONTEND_METRICS_X;
+    layout.metrics_y = FRONTEND_METRICS_Y + (rows - 1) * FRONTEND_TILE_HEIGHT;
+
+    return layout;
+}
+
+WINDOW * create_window(int x, int y, int w, int h) {
+    WINDOW * new_win = newwin(h, w, y, x);
+    box(new_win, 0, 0);
+    wrefresh(new_win);
+
+    return new_win;
+}
+
+// Terminal row `row` of the display holds pixel rows 2 * row and 2 * row + 1
+void draw_display_row(WINDOW * display, const Chip8 &sys, int row) {
+    int y = row * 2;
+
+    // check y and y+1 and set that pix to ▀, ▄, or █
+    for (int x = 0; x < 64; x++) {
+        int top_pix = sys.pixel(x, y);
+        int bot_pix = sys.pixel(x, y+1);
+
+        if (top_pix && bot_pix) {
+            mvwprintw(display, row+1, x+1, FRONTEND_PIX_BOTH);
+        }
+        else if (top_pix) {
+            mvwprintw(display, row+1, x+1, FRONTEND_PIX_TOP);
+        }
+        else if (bot_pix) {
+            mvwprintw(display, row+1, x+1, FRONTEND_PIX_BTM);
+        }
+        else {
+            mvwprintw(display, row+1, x+1, " ");
+        }
+    }
+}
+
+void draw_display(struct chip_frontend * fe) {
+    for (int row = 0; row < FRONTEND_SCREEN_HEIGHT; row++) {
+        draw_display_row(fe->display_win, *fe->sys, row);
+    }
+
+    wrefresh(fe->display_win);
+}
+
+void setup_instance_windows(struct chip_frontend * fe)
+{
+    fe->display_win = create_window(
+        fe->layout.screen_x,
+        fe->layout.screen_y,
+        FRONTEND_SCREEN_WIDTH + 2,
+        FRONTEND_SCREEN_HEIGHT + 2);
+
+    fe->sidebar_win = create_window(
+        fe->layout.sidebar_x,
+        fe->layout.sidebar_y,
+        FRONTEND_SIDEBAR_WIDTH + 2,
+        FRONTEND_SIDEBAR_HEIGHT + 2);
+}
+
+void setup_windows(struct chip_frontend * fe)
+{
+    setup_instance_windows(fe);
+
+    fe->helpbar_win = create_window(
+        fe->layout.helpbar_x,
+        fe->layout.helpbar_y,
+        FRONTEND_HELPBAR_WIDTH + 4,
+        FRONTEND_HELPBAR_HEIGHT + 2);
+}
+
+void write_starting_info(chip_frontend &fe)
+{
+    mvwprintw(fe.display_win, 0, FRONTEND_SCREEN_WIDTH / 2 - 5 + 1, "CURSEDCHIP");
+    wrefresh(fe.display_win);
+
+    mvwprintw(fe.sidebar_win, 0, 3, "DEBUG & INFO");
+    wrefresh(fe.sidebar_win);
+
+    mvwprintw(fe.helpbar_win, 1, 1, "QUIT: [Esc] PLAY/PAUSE: [.] STEP: [,] METRICS: [m] BRK: [b]");
+    wrefresh(fe.helpbar_win);
+}
+
+#ifdef CHIP8_PROFILE
+void write_hot_addresses(chip_frontend &fe) {
+    const Chip8Profile &profile = fe.sys->profile;
+
+    // Ranking all of RAM is too slow for every cycle
+    if (!fe.paused && (profile.cycles % FRONTEND_HOT_INTERVAL) != 0) {
+        return;
+    }
+
+    word hot[FRONTEND_HOT_ROWS];
+    int found = fe.sys->hottestAddresses(hot, FRONTEND_HOT_ROWS);
+
+    mvwprintw(fe.sidebar_win, 10, 1, "HOT ADDRESSES");
+    for (int i = 0; i < FRONTEND_HOT_ROWS; i++) {
+        if (i < found) {
+            mvwprintw(fe.sidebar_win, 11 + i, 1, "%03x %5.1f%%      ",
+                hot[i], 100.0 * profile.address[hot[i]] / (profile.cycles ? profile.cycles : 1));
+        } else {
+            mvwprintw(fe.sidebar_win, 11 + i, 1, "                ");
+        }
+    }
+}
+#endif
+
+// Fill the sidebar without sending it to the terminal
+void write_debug_text(chip_frontend &fe) {
+    bool breakpoint = fe.debugger && fe.debugger->hasBreakpoint(fe.sys->programCounter % CHIP8_RAM_BYTES);
+
+    wattron(fe.sidebar_win, COLOR_PAIR(2));
+    mvwprintw(fe.sidebar_win, 1, 1, "PC: %04x %s", fe.sys->programCounter, breakpoint ? "BRK" : "   ");
+    
+    // Print 4 rows of variable register contents
+    for (int i = 0; i <= 12; i += 4) {
+        mvwprintw(
+            fe.sidebar_win, 2 + (i / 4), 1, "V%x: %02x %02x %02x %02x", 
+            i,
+            fe.sys->variableRegisters[i+0], fe.sys->variableRegisters[i+1],
+            fe.sys->variableRegisters[i+2], fe.sys->variableRegisters[i+3]
+        );
+    }
+    mvwprintw(fe.sidebar_win, 6, 1, "IR: %04x SP: %02x", fe.sys->indexRegister, fe.sys->stackPointer);
+    mvwprintw(fe.sidebar_win, 7, 1, "KEY: %01d%01d%01d%01d%01d%01d%01d%01d",
+        fe.sys->keyState[0], fe.sys->keyState[1], fe.sys->keyState[2], fe.sys->keyState[3],
+        fe.sys->keyState[4], fe.sys->keyState[5], fe.sys->keyState[6], fe.sys->keyState[7]
+    );
+    mvwprintw(fe.sidebar_win, 8, 1, "     %01d%01d%01d%01d%01d%01d%01d%01d",
+        fe.sys->keyState[8], fe.sys->keyState[9], fe.sys->keyState[10], fe.sys->keyState[11],
+        fe.sys->keyState[12], fe.sys->keyState[13], fe.sys->keyState[14], fe.sys->keyState[15]
+    );
+    wattroff(fe.sidebar_win, COLOR_PAIR(2));
+
+#ifdef CHIP8_PROFILE
+    write_hot_addresses(fe);
+#endif
+}
+
+void write_debug_info(chip_frontend &fe) {
+    write_debug_text(fe);
+
+    refresh();
+    wrefresh(fe.sidebar_win);
+}
+
+
+void write_status(chip_frontend &fe, const char * status) {
+    mvwprintw(fe.helpbar_win, 1, FRONTEND_STATUS_X, "%-*s", FRONTEND_STATUS_WIDTH, status);
+    wrefresh(fe.helpbar_win);
+    refresh();
+}
+
+// PC, PC:vX<op>NN or vX<op>NN, all hex; op is one of == != < <= > >=
+bool parse_break_spec(Chip8Debugger &debugger, const std::string &spec) {
+    static const struct { const char * text; Chip8Compare compare; } ops[] = {
+        { "==", CHIP8_COMPARE_EQ }, { "!=", CHIP8_COMPARE_NE },
+        { "<",  CHIP8_COMPARE_LT }, { "<=", CHIP8_COMPARE_LE },
+        { ">",  CHIP8_COMPARE_GT }, { ">=", CHIP8_COMPARE_GE },
+    };
+    Chip8Condition condition;
+    unsigned int pc = CHIP8_DEBUG_ANY_PC;
+    std::string rest = spec;
+    int used = 0;
+
+    if (spec.empty()) {
+        return false;
+    }
+    if (spec[0] != 'v' && spec[0] != 'V') {
+        if (sscanf(spec.c_str(), "%x%n", &pc, &used) != 1 || pc >= CHIP8_RAM_BYTES) {
+            return false;
+        }
+        if (spec[used] == 0) {
+            debugger.setBreakpoint(pc, true);
+            return true;
+        }
+        if (spec[used] != ':') {
+            return false;
+        }
+        rest = spec.substr(used + 1);
+    }
+
+    unsigned int X, value;
+    char op[3] = {};
+    used = 0;
+    if (sscanf(rest.c_str(), "%*1[vV]%1x%2[=!<>]%x%n", &X, op, &value, &used) != 3
+            || rest[used] != 0 || value > 0xFF) {
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (strcmp(op, ops[i].text) == 0) {
+            condition.pc = pc;
+            condition.X = X;
+            condition.compare = ops[i].compare;
+            condition.value = value;
+            debugger.addCondition(condition);
+            return true;
+        }
+    }
+    return false;
+}
+
+// FIRST[-LAST][:r|w|rw], hex; watches writes when no mode is given
+bool parse_watch_spec(Chip8Debugger &debugger, const std::string &spec) {
+    Chip8Watch watch;
+    unsigned int first, last;
+    char mode[3] = {};
+
+    int fields = sscanf(spec.c_str(), "%x-%x:%2[rw]", &first, &last, mode);
+    if (fields < 2) {
+        last = first;
+        fields = sscanf(spec.c_str(), "%x:%2[rw]", &first, mode) + 1;
+    }
+    if (fields < 2 || first > last || last >= CHIP8_RAM_BYTES) {
+        return false;
+    }
+
+    std::string modes = mode[0] ? mode : "w";
+    watch.first = first;
+    watch.last = last;
+    watch.onRead = modes.find('r') != std::string::npos;
+    watch.onWrite = modes.find('w') != std::string::npos;
+    debugger.addWatch(watch);
+    return true;
+}
+
+void cycle_machine(chip_frontend &fe) {
+    if (fe.tracer) {
+        fe.tracer->step();
+    } else {
+        fe.sys->cycle();
+    }
+}
+
+void run_cycle(chip_frontend &fe, timespec &last_frame, timespec &now)
+{
+    // Cycle, through the instrumented loop only while anything is set
+    if (fe.debugger->active()) {
+        fe.debugger->run(1);
+
+        if (fe.debugger->stopReason && !fe.sys->fault) {
+            char reason[FRONTEND_STATUS_WIDTH + 1];
+            fe.paused = true;
+            write_status(fe, fe.debugger->describeStop(reason, sizeof(reason)));
+            write_debug_info(fe);
+            if (fe.live) {
+                fe.live->publish(*fe.sys);
+            }
+            return;
+        }
+    } else {
+        cycle_machine(fe);
+    }
+
+    if (fe.sys->fault) {
+        endwin();
+        if (fe.tracer) {
+            fe.tracer->close();
+        }
+        if (fe.exporter) {
+            fe.exporter->close();
+        }
+        if (fe.server) {
+            fe.server->close();
+        }
+        if (fe.live) {
+            fe.live->publish(*fe.sys);
+        }
+#ifdef CHIP8_PROFILE
+        fe.sys->dumpProfile();
+#endif
+        std::cerr << "Stopped at " << std::hex << fe.sys->programCounter
+            << ": " << faultName(fe.sys->fault) << std::endl;
+        exit(1);
+    }
+
+    // Every cycle, so readers follow key waits, timer loops and single steps too
+    if (fe.live) {
+        fe.live->publish(*fe.sys);
+    }
+
+    // Write info to debug area
+    if (metrics_enabled(fe.metrics)) {
+        long debug_start = now_ns();
+        write_debug_info(fe);
+        fe.metrics.frame_debug_ns += now_ns() - debug_start;
+    } else {
+        write_debug_info(fe);
+    }
+
+    // If sound flag set, make a sound and unset
+    if (fe.sys->sound)
+    {
+        printf("\07");
+        fe.sys->sound = false;
+    }
+
+    // If draw flag set, draw and unset
+    if (fe.sys->draw)
+    {
+        long draw_start = metrics_enabled(fe.metrics) ? now_ns() : 0;
+        draw_display(&fe);
+        fe.sys->draw = false;
+#ifdef CHIP8_PROFILE
+        fe.sys->profile.frames++;
+#endif
+        refresh();
+        wrefresh(fe.display_win);
+        if (fe.exporter) {
+            fe.exporter->frame(*fe.sys);
+        }
+        if (fe.server) {
+            fe.server->frame(*fe.sys);
+        }
+        if (metrics_enabled(fe.metrics)) {
+            metrics_frame(fe.metrics, now_ns() - draw_start);
+        }
+        if (last_frame.tv_nsec != -1) {
+            last_frame.tv_nsec = now.tv_nsec;
+            last_frame.tv_sec = now.tv_sec;
+        }
+    }
+}
+
+// No terminal: run up to cycles cycles, handing each drawn frame to the exporter
+int run_headless(chip_frontend &fe, long cycles) {
+    long ran = 0;
+
+    while (ran < cycles && !fe.sys->fault) {
+        if (fe.debugger->active()) {
+            fe.debugger->run(1);
+            if (fe.debugger->stopReason && !fe.sys->fault) {
+                char reason[FRONTEND_STATUS_WIDTH + 1];
+                std::cerr << "Stopped: " << fe.debugger->describeStop(reason, sizeof(reason)) << "\n";
+                if (fe.live) {
+                    fe.live->publish(*fe.sys);
+                }
+                break;
+            }
+        } else {
+            cycle_machine(fe);
+        }
+        ran++;
+
+        // Nothing can happen any more: no keys arrive headless, and a spin with
+        // both timers at zero only ever jumps to itself. The opcode is checked
+        // too, in case the program has overwritten the spin it was analysed with.
+        word pc = fe.sys->programCounter;
+        bool spinning = fe.analysis && fe.analysis->spinsAt(pc) && pc + 1 < CHIP8_RAM_BYTES
+            && combine(fe.sys->ram[pc], fe.sys->ram[pc + 1]) == (0x1000 | pc);
+        if (fe.sys->blockingForKey || (spinning && !fe.sys->delayTimer && !fe.sys->soundTimer)) {
+            std::cerr << "Idle at " << std::hex << fe.sys->programCounter << std::dec << ", stopping\n";
+            break;
+        }
+
+        if (fe.sys->draw) {
+            fe.sys->draw = false;
+            if (fe.live) {
+                fe.live->publish(*fe.sys);
+            }
+            if (fe.exporter) {
+                fe.exporter->frame(*fe.sys);
+            }
+        }
+    }
+
+    if (fe.tracer) {
+        fe.tracer->close();
+    }
+    if (fe.exporter) {
+        fe.exporter->close();
+        std::cerr << std::dec << ran << " cycles, " << fe.exporter->framesSeen << " frames, "
+            << fe.exporter->framesWritten << " written, " << fe.exporter->framesSkipped << " unchanged\n";
+    }
+    if (fe.sys->fault) {
+        std::cerr << "Stopped at " << std::hex << fe.sys->programCounter
+            << ": " << faultName(fe.sys->fault) << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int map_to_keypad(char inputc) {
+    switch (inputc) {
+        // Row 1: 1234 == 123C
+        case '1':
+        case '2':
+        case '3':
+            return inputc - '0';
+            break;
+        case '4':       return 0xC;     break;
+        
+        // Row 2: QWER == 456D
+        case 'Q':       return 0x4;     break;
+        case 'W':       return 0x5;     break;
+        case 'E':       return 0x6;     break;
+        case 'R':       return 0xD;     break;
+        
+        // Row 3: ASDF == 789E
+        case 'A':       return 0x7;     break;
+        case 'S':       return 0x8;     break;
+        case 'D':       return 0x9;     break;
+        case 'F':       return 0xE;     break;
+
+        // Row F: ZXCV == A0BF
+        case 'Z':       return 0xA;     break;
+        case 'X':       return 0x0;     break;
+        case 'C':       return 0xB;     break;
+        case 'V':       return 0xF;     break;
+
+    }
+    return -1;
+}
+
+// Released keys are cleared by the next handle_input()
+void press_key(chip_frontend &fe, int key, bool down) {
+    if (!down) {
+        fe.key_time_left[key] = 0;
+        return;
+    }
+
+    if (fe.sys->blockingForKey) {
+        fe.sys->lastKeyFromBlock = true;
+    }
+    if (metrics_enabled(fe.metrics)) {
+        metrics_key_event(fe.metrics);
+    }
+    fe.key_time_left[key] = 1000000;
+    fe.sys->keyState[key] = 1;
+    fe.sys->lastKey = key;
+}
+
+// New viewers, and keys from the ones already connected
+void poll_viewers(chip_frontend &fe) {
+    Chip8StreamKey keys[FRONTEND_VIEWER_KEYS];
+    int count = fe.server->poll(keys, FRONTEND_VIEWER_KEYS);
+
+    for (int i = 0; i < count; i++) {
+        press_key(fe, keys[i].key, keys[i].down);
+    }
+
+    // New or resyncing viewers get the display now; a paused machine draws nothing
+    if (fe.server->waiting()) {
+        fe.server->frame(*fe.sys);
+    }
+}
+
+char handle_input(chip_frontend &fe) {
+    char ch = getch();
+    
+    for (int i = 0; i < 16; i++) {
+
+        // Unset backend key state when the timer has gone off        
+        if (fe.key_time_left[i] == 0) {
+            fe.sys->keyState[i] = 0;
+        } else {
+            fe.key_time_left[i]--;
+        }
+    }
+
+    char mapped_key = map_to_keypad(ch);
+    if (mapped_key != -1) {
+        press_key(fe, mapped_key, true);
+        char status[FRONTEND_STATUS_WIDTH + 1];
+        snprintf(status, sizeof(status), "GOT KEY: %c AS %01x", ch, mapped_key);
+        write_status(fe, status);
+    }
+
+    if (ch == '.') {
+        fe.paused ^= 1;
+    }
+
+    if (ch == 'b') {
+        word pc = fe.sys->programCounter % CHIP8_RAM_BYTES;
+        char status[FRONTEND_STATUS_WIDTH + 1];
+        snprintf(status, sizeof(status), "BREAK %s %04x", fe.debugger->toggleBreakpoint(pc) ? "SET" : "CLEARED", pc);
+        write_status(fe, status);
+        write_debug_info(fe);
+    }
+
+    if (ch == 'm') {
+        toggle_metrics_overlay(fe.metrics, fe.layout.metrics_x, fe.layout.metrics_y, FRONTEND_METRICS_WIDTH);
+    }
+
+    // One instruction, through the debugger like any other cycle
+    if (fe.paused && ch == ',') {
+        timespec stupid_hack {-1, -1};
+        run_cycle(fe, stupid_hack, stupid_hack);
+    }
+
+    return ch;
+}
+
+// Maps the ROM or exits; the mapping only has to live until Chip8::load()
+void open_rom(Chip8Rom &rom, const std::string &filename) {
+    if (!rom.open(filename.c_str())) {
+        std::cout << "Cannot open " << filename << std::endl;
+        exit(1);
+    }
+}
+
+timespec timespec_sub(timespec start, timespec end) {
+    timespec temp;
+    
+    if ((end.tv_nsec-start.tv_nsec)<0) {
+        temp.tv_sec  = end.tv_sec-start.tv_sec-1;
+        temp.tv_nsec = 1000000000+end.tv_nsec-start.tv_nsec;
+    } else {
+        temp.tv_sec  = end.tv_sec-start.tv_sec;
+        temp.tv_nsec = end.tv_nsec-start.tv_nsec;
+    }
+    
+    return temp;
+};
@@ -1,305 +1,219 @@
 #include "chip8.hpp"
-#include "ncurses.h"
+#include "chip8pool.hpp"
+#include "frontend.hpp"
+#include "tiles.hpp"
+#include <cerrno>
+#include <climits>
 #include <locale.h>
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <ctime>
-#include <cctype>
-#include <iostream>
-
-#define FRONTEND_SCREEN_WIDTH       ((CHIP8_SCREEN_WIDTH))
-#define FRONTEND_SCREEN_HEIGHT      ((CHIP8_SCREEN_HEIGHT / 2))
-#define FRONTEND_SCREEN_X           0
-#define FRONTEND_SCREEN_Y           0
-
-#define FRONTEND_SIDEBAR_HEIGHT     (FRONTEND_SCREEN_HEIGHT)
-#define FRONTEND_SIDEBAR_WIDTH      18
-#define FRONTEND_SIDEBAR_X          (FRONTEND_SCREEN_WIDTH + 2)
-#define FRONTEND_SIDEBAR_Y          0
-
-#define FRONTEND_HELPBAR_HEIGHT     1
-#define FRONTEND_HELPBAR_WIDTH      (FRONTEND_SCREEN_WIDTH + FRONTEND_SIDEBAR_WIDTH)
-#define FRONTEND_HELPBAR_X          0
-#define FRONTEND_HELPBAR_Y          (FRONTEND_SCREEN_HEIGHT + 2)
-
-#define FRONTEND_PIX_TOP            "▀"
-#define FRONTEND_PIX_BTM            "▄"
-#define FRONTEND_PIX_BOTH           "█"
-
-#define NS_IN_SECOND                1000000000
-#define CURSE_CHIP_FRAMERATE        20
-
-struct chip_frontend {
-    Chip8 * sys;
-    WINDOW * display_win;
-    WINDOW * sidebar_win;
-    WINDOW * helpbar_win;
-    bool paused;
-    int key_time_left[16];
-};
-
-WINDOW * create_window(int x, int y, int w, int h) {
-    WINDOW * new_win = newwin(h, w, y, x);
-    box(new_win, 0, 0);
-    wrefresh(new_win);
-
-    return new_win;
-}
 
-void draw_display(struct chip_frontend * fe) {
-    WINDOW * display = fe->display_win;
+// A whole number from 1 to max, or exit naming the flag
+long parse_count(const std::string &flag, const char * text, long max) {
+    char * end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
 
-    for (int y = 0; y < 32; y += 2) {
-        // each y is 2 rows
-        // so check y and y+1 and set that pix to ▀, ▄, or █
-        for (int x = 0; x < 64; x++) {
-            int top_pix = fe->sys->displayBuffer[y][x]; 
-            int bot_pix = fe->sys->displayBuffer[y+1][x];
-
-            if (top_pix && bot_pix) {
-                mvwprintw(display, (y/2)+1, x+1, FRONTEND_PIX_BOTH);
-            }
-            else if (top_pix) {
-                mvwprintw(display, (y/2)+1, x+1, FRONTEND_PIX_TOP);
-            }
-            else if (bot_pix) {
-                mvwprintw(display, (y/2)+1, x+1, FRONTEND_PIX_BTM);
-            }
-            else {
-                mvwprintw(display, (y/2)+1, x+1, " ");
-            }
-        }
+    if (end == text || *end || errno == ERANGE || value < 1 || value > max) {
+        std::cout << flag << " takes a number from 1 to " << max << ", not " << text << std::endl;
+        exit(1);
     }
-
-    wrefresh(display);
+    return value;
 }
 
-
-void setup_windows(struct chip_frontend * fe)
-{
-    fe->display_win = create_window(
-        FRONTEND_SCREEN_X,
-        FRONTEND_SCREEN_Y,
-        FRONTEND_SCREEN_WIDTH + 2,
-        FRONTEND_SCREEN_HEIGHT + 2);
-
-    fe->sidebar_win = create_window(
-        FRONTEND_SIDEBAR_X,
-        FRONTEND_SIDEBAR_Y,
-        FRONTEND_SIDEBAR_WIDTH + 2,
-        FRONTEND_SIDEBAR_HEIGHT + 2);
-
-    fe->helpbar_win = create_window(
-        FRONTEND_HELPBAR_X,
-        FRONTEND_HELPBAR_Y,
-        FRONTEND_HELPBAR_WIDTH + 4,
-        FRONTEND_HELPBAR_HEIGHT + 2);
-}
-
-void write_starting_info(chip_frontend &fe)
+int main(int argc, char ** argv)
 {
-    mvwprintw(fe.display_win, 0, FRONTEND_SCREEN_WIDTH / 2 - 5 + 1, "CURSEDCHIP");
-    wrefresh(fe.display_win);
-
-    mvwprintw(fe.sidebar_win, 0, 3, "DEBUG & INFO");
-    wrefresh(fe.sidebar_win);
 
-    mvwprintw(fe.helpbar_win, 1, 1, "QUIT: [Esc] PLAY/PAUSE: [.] STEP: [,]");
-    wrefresh(fe.helpbar_win);
-}
-
-void write_debug_info(chip_frontend &fe) {
-    wattron(fe.sidebar_win, COLOR_PAIR(2));
-    mvwprintw(fe.sidebar_win, 1, 1, "PC: %04x", fe.sys->programCounter);
-    
-    // Print 4 rows of variable register contents
-    for (int i = 0; i <= 12; i += 4) {
-        mvwprintw(
-            fe.sidebar_win, 2 + (i / 4), 1, "V%x: %02x %02x %02x %02x", 
-            i,
-            fe.sys->variableRegisters[i+0], fe.sys->variableRegisters[i+1],
-            fe.sys->variableRegisters[i+2], fe.sys->variableRegisters[i+3]
-        );
+    if (argc < 2) {
+        std::cout << "Usage: ./chipcurses [--metrics out.csv] [--break spec]... [--watch spec]... [--trace out.trace] [--publish name] [--serve socket] filename.rom" << std::endl;
+        std::cout << "       ./chipcurses [--headless [--cycles N]] --export out.y4m|out.pbm|- [--format pbm|y4m] [--every N] [--scale N] filename.rom" << std::endl;
+        std::cout << "       ./chipcurses first.rom second.rom ..." << std::endl;
+        std::cout << "       ./chipcurses --analyze filename.rom..." << std::endl;
+        std::cout << "       ./chipcurses --layout" << std::endl;
+        exit(1);
     }
-    mvwprintw(fe.sidebar_win, 6, 1, "IR: %04x SP: %02x", fe.sys->indexRegister, fe.sys->stackPointer);
-    mvwprintw(fe.sidebar_win, 7, 1, "KEY: %01d%01d%01d%01d%01d%01d%01d%01d",
-        fe.sys->keyState[0], fe.sys->keyState[1], fe.sys->keyState[2], fe.sys->keyState[3],
-        fe.sys->keyState[4], fe.sys->keyState[5], fe.sys->keyState[6], fe.sys->keyState[7]
-    );
-    mvwprintw(fe.sidebar_win, 8, 1, "     %01d%01d%01d%01d%01d%01d%01d%01d",
-        fe.sys->keyState[8], fe.sys->keyState[9], fe.sys->keyState[10], fe.sys->keyState[11],
-        fe.sys->keyState[12], fe.sys->keyState[13], fe.sys->keyState[14], fe.sys->keyState[15]
-    );
-    wattroff(fe.sidebar_win, COLOR_PAIR(2));
-    refresh();
-    wrefresh(fe.sidebar_win);
-}
-
 
-void run_cycle(chip_frontend &fe, timespec &last_frame, timespec &now)
-{
-    // Cycle
-    fe.sys->cycle();
+    if (std::string(argv[1]) == "--layout") {
+        printLayoutReport(std::cout);
+        return 0;
+    }
 
-    // Write info to debug area
-    write_debug_info(fe);
+    std::vector<std::string> filenames;
+    std::string metricsFile;
+    std::string traceFile;
+    std::string liveName;
+    std::string servePath;
+    std::vector<std::string> breakSpecs;
+    std::vector<std::string> watchSpecs;
+    std::string exportFile;
+    std::string exportFormat;
+    int exportEvery = 1;
+    int exportScale = 1;
+    bool headless = false;
+    bool analyzeOnly = false;
+    long headlessCycles = 1000000;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--metrics" && i + 1 < argc)         metricsFile = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc)      traceFile = argv[++i];
+        else if (arg == "--publish" && i + 1 < argc)    liveName = argv[++i];
+        else if (arg == "--serve" && i + 1 < argc)      servePath = argv[++i];
+        else if (arg == "--break" && i + 1 < argc)      breakSpecs.push_back(argv[++i]);
+        else if (arg == "--watch" && i + 1 < argc)      watchSpecs.push_back(argv[++i]);
+        else if (arg == "--export" && i + 1 < argc)     exportFile = argv[++i];
+        else if (arg == "--format" && i + 1 < argc)     exportFormat = argv[++i];
+        else if (arg == "--every" && i + 1 < argc)      exportEvery = parse_count(arg, argv[++i], INT_MAX);
+        else if (arg == "--scale" && i + 1 < argc)      exportScale = parse_count(arg, argv[++i], CHIP8_EXPORT_MAX_SCALE);
+        else if (arg == "--cycles" && i + 1 < argc)     headlessCycles = parse_count(arg, argv[++i], LONG_MAX);
+        else if (arg == "--headless")                   headless = true;
+        else if (arg == "--analyze")                    analyzeOnly = true;
+        else                                            filenames.push_back(arg);
+    }
 
-    // If sound flag set, make a sound and unset
-    if (fe.sys->sound)
-    {
-        printf("\07");
-        fe.sys->sound = false;
+    if (filenames.empty()) {
+        std::cout << "No ROM given" << std::endl;
+        exit(1);
     }
 
-    // If draw flag set, draw and unset
-    if (fe.sys->draw)
-    {
-        draw_display(&fe);
-        fe.sys->draw = false;
-        refresh();
-        wrefresh(fe.display_win);
-        if (last_frame.tv_nsec != -1) {
-            last_frame.tv_nsec = now.tv_nsec;
-            last_frame.tv_sec = now.tv_sec;
+    // Blocks, quirk-sensitive opcodes and idle loops, from the cache when it has them
+    if (analyzeOnly) {
+        for (size_t i = 0; i < filenames.size(); i++) {
+            Chip8Rom rom;
+            open_rom(rom, filenames[i]);
+            Chip8RomAnalysis analysis;
+            bool cached = analysis.loadOrAnalyze(rom);
+            printf("%s (%d bytes, %s)\n", filenames[i].c_str(), rom.size(), cached ? "cached" : "analysed");
+            analysis.print(stdout);
         }
+        return 0;
     }
-}
 
-int map_to_keypad(char inputc) {
-    switch (inputc) {
-        // Row 1: 1234 == 123C
-        case '1':
-        case '2':
-        case '3':
-            return inputc - '0';
-            break;
-        case '4':       return 0xC;     break;
-        
-        // Row 2: QWER == 456D
-        case 'Q':       return 0x4;     break;
-        case 'W':       return 0x5;     break;
-        case 'E':       return 0x6;     break;
-        case 'R':       return 0xD;     break;
-        
-        // Row 3: ASDF == 789E
-        case 'A':       return 0x7;     break;
-        case 'S':       return 0x8;     break;
-        case 'D':       return 0x9;     break;
-        case 'F':       return 0xE;     break;
-
-        // Row F: ZXCV == A0BF
-        case 'Z':       return 0xA;     break;
-        case 'X':       return 0x0;     break;
-        case 'C':       return 0xB;     break;
-        case 'V':       return 0xF;     break;
+    // Set locale for unicode
+    setlocale(LC_ALL, "");
 
+    // Several ROMs: tiled, one core thread each, without the single-machine tools
+    if (filenames.size() > 1) {
+        if (!metricsFile.empty() || !traceFile.empty() || !liveName.empty() || !breakSpecs.empty() || !watchSpecs.empty()
+            || !exportFile.empty() || !servePath.empty() || headless) {
+            std::cout << "--metrics, --trace, --publish, --serve, --break, --watch, --export and --headless take a single ROM" << std::endl;
+            exit(1);
+        }
+        return run_tiled(filenames);
     }
-    return -1;
-}
 
-char handle_input(chip_frontend &fe) {
-    char ch = getch();
-    
-    for (int i = 0; i < 16; i++) {
+    // Set up backend
+    struct chip_frontend fe = {};
+    fe.paused = true;
+    fe.sys = new Chip8();
+    fe.sys->reset();
+    fe.debugger = new Chip8Debugger(*fe.sys);
 
-        // Unset backend key state when the timer has gone off        
-        if (fe.key_time_left[i] == 0) {
-            fe.sys->keyState[i] = 0;
-        } else {
-            fe.key_time_left[i]--;
+    if (!traceFile.empty()) {
+        fe.tracer = new Chip8Tracer(*fe.sys);
+        if (!fe.tracer->open(traceFile.c_str())) {
+            std::cout << "Cannot open " << traceFile << std::endl;
+            exit(1);
         }
+        fe.debugger->tracer = fe.tracer;
     }
 
-    char mapped_key = map_to_keypad(ch);
-    if (mapped_key != -1) {
-        if (fe.sys->blockingForKey) {
-            fe.sys->lastKeyFromBlock = true;
+    // Registers, stack, timers, keys and display for outside inspectors, once per cycle
+    if (!liveName.empty()) {
+        fe.live = new Chip8LiveExport();
+        if (!fe.live->open(liveName.c_str(), true)) {
+            std::cout << "Cannot create shared memory " << liveName << std::endl;
+            exit(1);
         }
-        fe.key_time_left[mapped_key] = 1000000;
-        fe.sys->keyState[mapped_key] = 1;
-        fe.sys->lastKey = mapped_key;
-        mvwprintw(fe.helpbar_win, 1, 40, "GOT KEY: %c AS %01x", ch, mapped_key);
-        wrefresh(fe.helpbar_win);
-        refresh();
     }
 
-    if (ch == '.') {
-        fe.paused ^= 1;
+    // Display deltas out to chip8-view, key events back in
+    if (!servePath.empty()) {
+        if (headless) {
+            std::cout << "--serve needs the terminal frontend" << std::endl;
+            exit(1);
+        }
+        fe.server = new Chip8StreamServer();
+        if (!fe.server->open(servePath.c_str())) {
+            std::cout << "Cannot listen on " << servePath << ": " << strerror(errno) << std::endl;
+            exit(1);
+        }
     }
 
-    if (fe.paused && ch == ',') {
-        fe.sys->cycle();
-        timespec stupid_hack {-1, -1};
-        run_cycle(fe, stupid_hack, stupid_hack);
+    // Breakpoints: 2a4, 2a4:v3==05 or v3>10; watches: 200-3ff:rw, default writes
+    for (size_t i = 0; i < breakSpecs.size(); i++) {
+        if (!parse_break_spec(*fe.debugger, breakSpecs[i])) {
+            std::cout << "Bad breakpoint " << breakSpecs[i] << std::endl;
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < watchSpecs.size(); i++) {
+        if (!parse_watch_spec(*fe.debugger, watchSpecs[i])) {
+            std::cout << "Bad watchpoint " << watchSpecs[i] << std::endl;
+            exit(1);
+        }
     }
 
-    return ch;
-}
-
-byte * load_file_buf(const std::string &filename) {
-	byte * fileBuf = new byte[CHIP8_ROM_BYTES];
-	std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
-
-	do {
-		in.read((char *) fileBuf, CHIP8_ROM_BYTES);
-	} while (in.gcount() > 0);
+    // Format from --format, else the extension; stdout defaults to PBM
+    if (!exportFile.empty()) {
+        // The terminal frontend owns stdout
+        if (exportFile == "-" && !headless) {
+            std::cout << "--export - needs --headless" << std::endl;
+            exit(1);
+        }
+        if (!exportFormat.empty() && exportFormat != "pbm" && exportFormat != "y4m") {
+            std::cout << "Unknown format " << exportFormat << std::endl;
+            exit(1);
+        }
 
-	return fileBuf;
-}
+        bool y4m = exportFormat.empty()
+            ? exportFile.size() > 4 && exportFile.compare(exportFile.size() - 4, 4, ".y4m") == 0
+            : exportFormat == "y4m";
 
-timespec timespec_sub(timespec start, timespec end) {
-    timespec temp;
-    
-    if ((end.tv_nsec-start.tv_nsec)<0) {
-        temp.tv_sec  = end.tv_sec-start.tv_sec-1;
-        temp.tv_nsec = 1000000000+end.tv_nsec-start.tv_nsec;
-    } else {
-        temp.tv_sec  = end.tv_sec-start.tv_sec;
-        temp.tv_nsec = end.tv_nsec-start.tv_nsec;
+        fe.exporter = new Chip8FrameExport();
+        fe.exporter->every = exportEvery;
+        fe.exporter->scale = exportScale;
+        if (!fe.exporter->open(exportFile.c_str(), y4m ? CHIP8_EXPORT_Y4M : CHIP8_EXPORT_PBM)) {
+            std::cout << "Cannot open " << exportFile << std::endl;
+            exit(1);
+        }
     }
-    
-    return temp;
-};
 
+    // The mapping is only needed until the machine has its copy
+    {
+        Chip8Rom rom;
+        open_rom(rom, filenames[0]);
+        fe.analysis = new Chip8RomAnalysis();
+        fe.analysis->loadOrAnalyze(rom);
+        fe.sys->load(rom.data());
+    }
 
-int main(int argc, char ** argv)
-{
-
-    if (argc < 2) {
-        std::cout << "Usage: ./chipcurses filename.rom" << std::endl;
-        exit(1);
+    if (headless) {
+        return run_headless(fe, headlessCycles);
     }
 
-    // Set locale for unicode
-    setlocale(LC_ALL, "");
+    // Writer threads and viewers land in the same count as the terminal
+    fe.metrics.process_bytes = fe.tracer || fe.exporter || fe.server;
 
-    // Set up backend
-    struct chip_frontend fe;
-    fe.paused = true;
-    fe.sys = new Chip8();
-    fe.sys->reset();
+    if (!metricsFile.empty()) {
+        fe.metrics.csv = fopen(metricsFile.c_str(), "w");
+        if (!fe.metrics.csv) {
+            std::cout << "Cannot open " << metricsFile << std::endl;
+            exit(1);
+        }
+        fprintf(fe.metrics.csv, "%s\n", fe.metrics.process_bytes ? METRICS_CSV_HEADER_PROCESS : METRICS_CSV_HEADER);
+    }
 
     // Initialize ncurses
-    initscr();
-    cbreak();
-    keypad(stdscr, TRUE);
-    noecho();
-    nodelay(stdscr, TRUE);
-    
-    // Set up terminal colours
-    if (has_colors() == FALSE) {
-        endwin();
-		printf("Your terminal does not support color\n");
-		exit(1);
-	}
-
-    // start_color();
-    init_pair(1, COLOR_BLUE, COLOR_BLACK);
-    init_pair(2, COLOR_BLACK, COLOR_GREEN);
-
-    refresh();
+    init_curses();
 
+    fe.layout = instance_layout(0, 1, 1);
     setup_windows(&fe);
 
     // Write some title cards
@@ -308,10 +222,6 @@ int main(int argc, char ** argv)
     // Both created, update parent window
     refresh();
 
-    // Load file
-    std::string filename = argv[1];
-    fe.sys->load(load_file_buf(filename));
-    
     // Main loop
     bool waiting = false;
     timespec last_frame;
@@ -319,7 +229,11 @@ int main(int argc, char ** argv)
     timespec now;
     
     while ((handle_input(fe) != 27)) {
-        
+        // Viewers connect and press keys whether or not the machine is running
+        if (fe.server) {
+            poll_viewers(fe);
+        }
+
         if (fe.paused) {
         
         } else {
@@ -336,5 +250,29 @@ int main(int argc, char ** argv)
 
     endwin();
 
+    if (fe.metrics.csv) {
+        fclose(fe.metrics.csv);
+    }
+
+    if (fe.tracer) {
+        fe.tracer->close();
+    }
+
+    if (fe.exporter) {
+        fe.exporter->close();
+    }
+
+    if (fe.server) {
+        fe.server->close();
+    }
+
+    if (fe.live) {
+        Chip8LiveExport::unlink(liveName.c_str());
+    }
+
+#ifdef CHIP8_PROFILE
+    fe.sys->dumpProfile();
+#endif
+
     return 0;
 }
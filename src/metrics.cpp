@@ -0,0 +1,148 @@
+#include "metrics.hpp"
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+static int bucket_for(long ns) {
+    if (ns < METRICS_SUB_BUCKETS) {
+        return ns < 0 ? 0 : (int) ns;
+    }
+    int msb = 63 - __builtin_clzl(ns);
+    int sub = (ns >> (msb - 3)) & (METRICS_SUB_BUCKETS - 1);
+    return (msb - 2) * METRICS_SUB_BUCKETS + sub;
+}
+
+static long bucket_floor(int bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return bucket;
+    }
+    int msb = bucket / METRICS_SUB_BUCKETS + 2;
+    long sub = bucket % METRICS_SUB_BUCKETS;
+    return (METRICS_SUB_BUCKETS + sub) << (msb - 3);
+}
+
+void histogram_add(duration_histogram &h, long ns) {
+    h.counts[bucket_for(ns)]++;
+    h.total++;
+}
+
+long histogram_percentile(const duration_histogram &h, double p) {
+    unsigned long target = (unsigned long) (p * h.total);
+    unsigned long seen = 0;
+
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        seen += h.counts[i];
+        if (seen > target) {
+            return bucket_floor(i);
+        }
+    }
+    return 0;
+}
+
+long now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+unsigned long process_bytes_written(frontend_metrics &m) {
+    unsigned long wchar = 0;
+
+    if (!m.proc_io) {
+        m.proc_io = fopen("/proc/self/io", "r");
+        if (!m.proc_io) {
+            return 0;
+        }
+    }
+
+    // pread rather than stdio, which would serve a rewind from its stale buffer
+    char buf[256];
+    ssize_t got = pread(fileno(m.proc_io), buf, sizeof(buf) - 1, 0);
+    if (got <= 0) {
+        return 0;
+    }
+    buf[got] = 0;
+
+    const char * field = strstr(buf, "wchar:");
+    if (field) {
+        sscanf(field, "wchar: %lu", &wchar);
+    }
+    return wchar;
+}
+
+bool metrics_enabled(const frontend_metrics &m) {
+    return m.overlay || m.csv;
+}
+
+void metrics_key_event(frontend_metrics &m) {
+    if (!m.key_ns) {
+        m.key_ns = now_ns();
+    }
+}
+
+void metrics_frame(frontend_metrics &m, long draw_ns) {
+    long now = now_ns();
+    long frame_ns = m.last_frame_ns ? now - m.last_frame_ns : 0;
+    long latency_ns = m.key_ns ? now - m.key_ns : 0;
+
+    unsigned long bytes = process_bytes_written(m);
+
+    m.frames++;
+    m.last_frame_bytes = m.frame_start_bytes ? bytes - m.frame_start_bytes : 0;
+    m.total_bytes += m.last_frame_bytes;
+
+    if (m.last_frame_ns) histogram_add(m.frame_time, frame_ns);
+    if (m.key_ns) histogram_add(m.input_latency, latency_ns);
+    histogram_add(m.draw_time, draw_ns);
+    histogram_add(m.debug_time, m.frame_debug_ns);
+
+    if (m.csv) {
+        fprintf(m.csv, "%lu,%ld,%ld,%ld,%lu,", m.frames, frame_ns, draw_ns, m.frame_debug_ns, m.last_frame_bytes);
+        if (m.key_ns) {
+            fprintf(m.csv, "%ld", latency_ns);
+        }
+        fprintf(m.csv, "\n");
+        fflush(m.csv);
+    }
+
+    if (m.overlay) {
+        write_metrics_overlay(m);
+    }
+
+    m.last_frame_ns = now;
+    m.key_ns = 0;
+    m.frame_debug_ns = 0;
+
+    // Taken after the CSV row so the next frame counts only terminal output
+    m.frame_start_bytes = process_bytes_written(m);
+}
+
+void toggle_metrics_overlay(frontend_metrics &m, int x, int y, int w) {
+    m.overlay ^= 1;
+
+    if (m.overlay) {
+        m.overlay_win = newwin(5, w, y, x);
+        box(m.overlay_win, 0, 0);
+        mvwprintw(m.overlay_win, 0, 3, "METRICS");
+        write_metrics_overlay(m);
+    } else {
+        werase(m.overlay_win);
+        wrefresh(m.overlay_win);
+        delwin(m.overlay_win);
+        m.overlay_win = nullptr;
+    }
+}
+
+void write_metrics_overlay(frontend_metrics &m) {
+    double ms = 1e-6;
+
+    mvwprintw(m.overlay_win, 1, 1, "FRAME p50 %8.2fms p99 %8.2fms   DRAW  p50 %7.2fms p99 %7.2fms",
+        histogram_percentile(m.frame_time, 0.50) * ms, histogram_percentile(m.frame_time, 0.99) * ms,
+        histogram_percentile(m.draw_time, 0.50) * ms, histogram_percentile(m.draw_time, 0.99) * ms);
+    mvwprintw(m.overlay_win, 2, 1, "DEBUG p50 %8.2fms p99 %8.2fms   INPUT p50 %7.2fms p99 %7.2fms",
+        histogram_percentile(m.debug_time, 0.50) * ms, histogram_percentile(m.debug_time, 0.99) * ms,
+        histogram_percentile(m.input_latency, 0.50) * ms, histogram_percentile(m.input_latency, 0.99) * ms);
+    mvwprintw(m.overlay_win, 3, 1, "%s last %7lu avg %9.1f   FRAMES %lu",
+        m.process_bytes ? "PROC B/FRAME" : "BYTES/FRAME ", m.last_frame_bytes, m.frames ? (double) m.total_bytes / m.frames : 0.0, m.frames);
+    wrefresh(m.overlay_win);
+}
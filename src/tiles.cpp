@@ -0,0 +1,205 @@
+#include "tiles.hpp"
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+
+static void advance(timespec &t, long ns) {
+    t.tv_nsec += ns;
+    if (t.tv_nsec >= NS_IN_SECOND) {
+        t.tv_nsec -= NS_IN_SECOND;
+        t.tv_sec++;
+    }
+}
+
+static void tile_core(tile_instance &tile, const std::atomic<bool> &stop) {
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!stop) {
+        {
+            std::lock_guard<std::mutex> guard(tile.lock);
+            for (int i = 0; i < FRONTEND_TILE_CYCLES && !tile.fe.paused && !tile.fe.sys->fault; i++) {
+                tile.fe.sys->cycle();
+            }
+        }
+        advance(next, NS_IN_SECOND / FRONTEND_TILE_FRAMERATE);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+}
+
+static void write_tile_title(tile_instance &tile, const Chip8 &view, bool paused, bool focused) {
+    char title[FRONTEND_SCREEN_WIDTH + 1];
+
+    if (view.fault) {
+        snprintf(title, sizeof(title), " %s: %s AT %04x ", tile.name.c_str(), faultName(view.fault), view.programCounter);
+    } else {
+        snprintf(title, sizeof(title), " %s%s ", tile.name.c_str(), paused ? " (PAUSED)" : "");
+    }
+    std::string next = std::string(focused ? "*" : " ") + title;
+
+    if (next == tile.title) {
+        return;
+    }
+    tile.title = next;
+
+    box(tile.fe.display_win, 0, 0);
+    if (focused) {
+        wattron(tile.fe.display_win, A_REVERSE);
+    }
+    mvwprintw(tile.fe.display_win, 0, 2, "%s", title);
+    wattroff(tile.fe.display_win, A_REVERSE);
+    wnoutrefresh(tile.fe.display_win);
+}
+
+// Composite one instance: only display rows that changed since the last frame
+static void render_tile(tile_instance &tile, Chip8 &view, bool focused) {
+    bool paused;
+    {
+        std::lock_guard<std::mutex> guard(tile.lock);
+        view = *tile.fe.sys;
+        paused = tile.fe.paused;
+    }
+
+    bool dirty = false;
+    for (int row = 0; row < FRONTEND_SCREEN_HEIGHT; row++) {
+        int y = row * 2;
+        if (tile.drawn && view.displayBuffer[y] == tile.shown[y] && view.displayBuffer[y + 1] == tile.shown[y + 1]) {
+            continue;
+        }
+        draw_display_row(tile.fe.display_win, view, row);
+        tile.shown[y] = view.displayBuffer[y];
+        tile.shown[y + 1] = view.displayBuffer[y + 1];
+        dirty = true;
+    }
+    tile.drawn = true;
+
+    write_tile_title(tile, view, paused, focused);
+    if (dirty) {
+        wnoutrefresh(tile.fe.display_win);
+    }
+
+    // The sidebar reads the copy, not the running machine
+    chip_frontend shadow;
+    shadow.sys = &view;
+    shadow.debugger = nullptr;
+    shadow.sidebar_win = tile.fe.sidebar_win;
+    shadow.paused = paused;
+    write_debug_text(shadow);
+    wnoutrefresh(tile.fe.sidebar_win);
+}
+
+static void press_tile_key(tile_instance &tile, int key) {
+    std::lock_guard<std::mutex> guard(tile.lock);
+    Chip8 &sys = *tile.fe.sys;
+
+    if (sys.blockingForKey) {
+        sys.lastKeyFromBlock = true;
+    }
+    sys.keyState[key] = 1;
+    sys.lastKey = key;
+    tile.fe.key_time_left[key] = FRONTEND_TILE_KEY_FRAMES;
+}
+
+static void release_tile_keys(tile_instance &tile) {
+    std::lock_guard<std::mutex> guard(tile.lock);
+
+    for (int i = 0; i < 16; i++) {
+        if (tile.fe.key_time_left[i] > 0 && --tile.fe.key_time_left[i] == 0) {
+            tile.fe.sys->keyState[i] = 0;
+        }
+    }
+}
+
+int run_tiled(const std::vector<std::string> &roms) {
+    int count = roms.size();
+
+    init_curses();
+
+    int columns = COLS / FRONTEND_TILE_WIDTH;
+    if (columns < 1) {
+        columns = 1;
+    }
+    if (columns > count) {
+        columns = count;
+    }
+    int rows = (count + columns - 1) / columns;
+
+    frontend_layout last = instance_layout(count - 1, columns, rows);
+    if (COLS < columns * FRONTEND_TILE_WIDTH || LINES < last.helpbar_y + FRONTEND_HELPBAR_HEIGHT + 2) {
+        endwin();
+        printf("Terminal too small for %d ROMs: need %dx%d\n", count,
+            columns * FRONTEND_TILE_WIDTH, last.helpbar_y + FRONTEND_HELPBAR_HEIGHT + 2);
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<tile_instance>> tiles;
+    for (int i = 0; i < count; i++) {
+        tile_instance * tile = new tile_instance();
+        size_t slash = roms[i].find_last_of('/');
+        tile->name = slash == std::string::npos ? roms[i] : roms[i].substr(slash + 1);
+        tile->fe.sys = new Chip8();
+        tile->fe.paused = true;         // Like a single ROM: [.] starts the focused tile
+        Chip8Rom rom;
+        open_rom(rom, roms[i]);
+        tile->fe.sys->load(rom.data());
+        tile->fe.layout = instance_layout(i, columns, rows);
+        setup_instance_windows(&tile->fe);
+        mvwprintw(tile->fe.sidebar_win, 0, 3, "DEBUG & INFO");
+        wnoutrefresh(tile->fe.sidebar_win);
+        tiles.push_back(std::unique_ptr<tile_instance>(tile));
+    }
+
+    WINDOW * helpbar = create_window(last.helpbar_x, last.helpbar_y, FRONTEND_HELPBAR_WIDTH + 4, FRONTEND_HELPBAR_HEIGHT + 2);
+    mvwprintw(helpbar, 1, 1, "QUIT: [Esc] PLAY/PAUSE: [.] FOCUS: [Tab]");
+    wnoutrefresh(helpbar);
+    for (int i = 0; i < count; i++) {
+        tiles[i]->fe.helpbar_win = helpbar;
+    }
+
+    std::atomic<bool> stop(false);
+    for (int i = 0; i < count; i++) {
+        tiles[i]->core = std::thread(tile_core, std::ref(*tiles[i]), std::cref(stop));
+    }
+
+    Chip8 * view = new Chip8();
+    int focus = 0;
+    bool quit = false;
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!quit) {
+        int ch;
+        while ((ch = getch()) != ERR) {
+            int key = map_to_keypad(ch);
+
+            if (ch == 27) {
+                quit = true;
+            } else if (ch == '\t') {
+                focus = (focus + 1) % count;
+            } else if (ch == '.') {
+                std::lock_guard<std::mutex> guard(tiles[focus]->lock);
+                tiles[focus]->fe.paused ^= 1;
+            } else if (key != -1) {
+                press_tile_key(*tiles[focus], key);
+            }
+        }
+
+        for (int i = 0; i < count; i++) {
+            release_tile_keys(*tiles[i]);
+            render_tile(*tiles[i], *view, i == focus);
+        }
+        doupdate();
+
+        advance(next, NS_IN_SECOND / FRONTEND_TILE_FRAMERATE);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+
+    stop = true;
+    for (int i = 0; i < count; i++) {
+        tiles[i]->core.join();
+    }
+    endwin();
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "chip8rom.hpp"
+#include "chip8trace.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// What dump prints; unset fields match everything
+struct trace_filter {
+    unsigned int pcFirst;
+    unsigned int pcLast;
+    word opMask;
+    word opValue;
+    bool writesOnly;
+    unsigned long from;
+    unsigned long count;
+};
+
+// Opcode pattern like Fx55 or 8xy4: hex digits must match, anything else is a wildcard
+bool parse_op_pattern(const char * pattern, word &mask, word &value) {
+    if (strlen(pattern) != 4) {
+        return false;
+    }
+
+    mask = 0;
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int shift = 12 - 4 * i;
+        if (isxdigit(pattern[i])) {
+            mask |= 0xF << shift;
+            value |= strtol(std::string(1, pattern[i]).c_str(), nullptr, 16) << shift;
+        }
+    }
+    return true;
+}
+
+void format_record(const Chip8TraceRecord &r, char * line, int size) {
+    int used = snprintf(line, size, "%8lu %04x %04x", r.index, r.programCounter, r.opcode);
+
+    if (r.flags & CHIP8_TRACE_INDEX) {
+        used += snprintf(line + used, size - used, " I=%03x", r.indexRegister);
+    }
+    for (int i = 0; i < CHIP8_VARIABLE_REGISTERS; i++) {
+        if ((r.changedRegisters >> i) & 1) {
+            used += snprintf(line + used, size - used, " V%x=%02x", i, r.variableRegisters[i]);
+        }
+    }
+    if (r.flags & CHIP8_TRACE_STACK) {
+        used += snprintf(line + used, size - used, " SP=%x", r.stackPointer);
+    }
+    if (r.flags & CHIP8_TRACE_TIMERS) {
+        used += snprintf(line + used, size - used, " DT=%02x ST=%02x", r.delayTimer, r.soundTimer);
+    }
+    if (r.writeLength) {
+        used += snprintf(line + used, size - used, " [%03x]=", r.writeAddress);
+        for (int i = 0; i < r.writeLength; i++) {
+            used += snprintf(line + used, size - used, "%02x", r.written[i]);
+        }
+    }
+    if (r.fault) {
+        snprintf(line + used, size - used, " %s", faultName(r.fault));
+    }
+}
+
+bool matches(const trace_filter &f, const Chip8TraceRecord &r) {
+    return r.index >= f.from
+        && r.programCounter >= f.pcFirst && r.programCounter <= f.pcLast
+        && (r.opcode & f.opMask) == f.opValue
+        && (!f.writesOnly || r.writeLength);
+}
+
+// Same instruction with the same effects
+bool same_record(const Chip8TraceRecord &a, const Chip8TraceRecord &b) {
+    return a.programCounter == b.programCounter && a.opcode == b.opcode
+        && a.indexRegister == b.indexRegister && a.stackPointer == b.stackPointer
+        && a.delayTimer == b.delayTimer && a.soundTimer == b.soundTimer
+        && !memcmp(a.variableRegisters, b.variableRegisters, CHIP8_VARIABLE_REGISTERS)
+        && a.writeLength == b.writeLength
+        && (!a.writeLength || (a.writeAddress == b.writeAddress && !memcmp(a.written, b.written, a.writeLength)))
+        && a.fault == b.fault;
+}
+
+int record(const std::string &romFile, const std::string &traceFile, long cycles) {
+    Chip8Rom rom;
+    if (!rom.open(romFile.c_str())) {
+        perror(romFile.c_str());
+        return 1;
+    }
+
+    Chip8 m;
+    m.load(rom.data());
+    rom.close();
+
+    Chip8Tracer tracer(m);
+    if (!tracer.open(traceFile.c_str())) {
+        perror(traceFile.c_str());
+        return 1;
+    }
+
+    for (long i = 0; i < cycles && !m.fault; i++) {
+        tracer.step();
+    }
+    tracer.close();
+
+    fprintf(stderr, "%lu instructions, %lu writer stalls%s%s\n", tracer.records, tracer.stalls,
+        m.fault ? ", stopped by " : "", m.fault ? faultName(m.fault) : "");
+    return 0;
+}
+
+int dump(const std::string &traceFile, const trace_filter &filter) {
+    Chip8TraceReader reader;
+    if (!reader.open(traceFile.c_str())) {
+        fprintf(stderr, "%s: not a trace\n", traceFile.c_str());
+        return 1;
+    }
+
+    Chip8TraceRecord r;
+    char line[256];
+    unsigned long shown = 0;
+
+    while (shown < filter.count && reader.next(r)) {
+        if (matches(filter, r)) {
+            format_record(r, line, sizeof(line));
+            printf("%s\n", line);
+            shown++;
+        }
+    }
+    if (reader.damaged) {
+        fprintf(stderr, "%s: damaged trace\n", traceFile.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int diff(const std::string &leftFile, const std::string &rightFile) {
+    Chip8TraceReader left, right;
+    if (!left.open(leftFile.c_str()) || !right.open(rightFile.c_str())) {
+        fprintf(stderr, "cannot read both traces\n");
+        return 2;
+    }
+
+    Chip8TraceRecord a, b;
+    char line[256];
+
+    for (unsigned long compared = 0; ; compared++) {
+        bool moreLeft = left.next(a);
+        bool moreRight = right.next(b);
+
+        if (left.damaged || right.damaged) {
+            fprintf(stderr, "%s: damaged after %lu instructions\n",
+                left.damaged ? leftFile.c_str() : rightFile.c_str(), compared);
+            return 2;
+        }
+        if (!moreLeft && !moreRight) {
+            printf("identical, %lu instructions\n", compared);
+            return 0;
+        }
+        if (moreLeft != moreRight) {
+            printf("%s ends first, after %lu instructions\n", moreLeft ? rightFile.c_str() : leftFile.c_str(), compared);
+            return 1;
+        }
+        if (!same_record(a, b)) {
+            printf("first difference at instruction %lu\n", a.index);
+            format_record(a, line, sizeof(line));
+            printf("< %s\n", line);
+            format_record(b, line, sizeof(line));
+            printf("> %s\n", line);
+            return 1;
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3) {
+        std::cout << "Usage: ./chip8-trace record filename.rom out.trace [--cycles N]" << std::endl;
+        std::cout << "       ./chip8-trace dump file.trace [--pc 200-2ff] [--op Fx55] [--writes] [--from N] [--count N]" << std::endl;
+        std::cout << "       ./chip8-trace diff a.trace b.trace" << std::endl;
+        exit(1);
+    }
+
+    std::string command = argv[1];
+
+    if (command == "record" && argc >= 4) {
+        long cycles = 1000000;
+        for (int i = 4; i + 1 < argc; i += 2) {
+            if (std::string(argv[i]) == "--cycles") cycles = atol(argv[i + 1]);
+        }
+        return record(argv[2], argv[3], cycles);
+    }
+
+    if (command == "dump") {
+        trace_filter filter = { 0, CHIP8_RAM_BYTES - 1, 0, 0, false, 0, (unsigned long) -1 };
+
+        for (int i = 3; i < argc; i++) {
+            std::string flag = argv[i];
+
+            if (flag == "--writes") {
+                filter.writesOnly = true;
+            } else if (i + 1 < argc) {
+                const char * value = argv[++i];
+
+                if (flag == "--pc") {
+                    if (sscanf(value, "%x-%x", &filter.pcFirst, &filter.pcLast) == 1) {
+                        filter.pcLast = filter.pcFirst;
+                    }
+                } else if (flag == "--from") {
+                    filter.from = strtoul(value, nullptr, 10);
+                } else if (flag == "--count") {
+                    filter.count = strtoul(value, nullptr, 10);
+                } else if (flag == "--op" && !parse_op_pattern(value, filter.opMask, filter.opValue)) {
+                    fprintf(stderr, "bad opcode pattern %s\n", value);
+                    return 1;
+                }
+            }
+        }
+        return dump(argv[2], filter);
+    }
+
+    if (command == "diff" && argc >= 4) {
+        return diff(argv[2], argv[3]);
+    }
+
+    fprintf(stderr, "unknown command %s\n", command.c_str());
+    return 1;
+}
@@ -0,0 +1,215 @@
+#include "chip8stream.hpp"
+#include "frontend.hpp"
+#include <locale.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Terminals have no key-up, so a press is released after this long
+#define VIEW_KEY_HOLD_NS            (100 * 1000000L)
+#define VIEW_POLL_MS                5
+
+int connect_to(const char * path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (sockaddr *) &address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool read_fully(int fd, byte * out, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, out, size);
+        if (n <= 0) {
+            return false;
+        }
+        out += n;
+        size -= n;
+    }
+    return true;
+}
+
+unsigned int get_long(const byte * in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((unsigned int) in[3] << 24);
+}
+
+qword get_row(const byte * in) {
+    qword row = 0;
+    for (int i = 0; i < 8; i++) {
+        row = (row << 8) | in[i];
+    }
+    return row;
+}
+
+// Apply one message to the display, adding the pixel rows it changed; false if it's malformed
+bool apply_message(Chip8 &view, byte type, const byte * payload, size_t length, unsigned int &changed, unsigned int &frame) {
+    if (type == CHIP8_STREAM_KEYFRAME) {
+        if (length != 4 + 8 * CHIP8_SCREEN_HEIGHT) {
+            return false;
+        }
+        frame = get_long(payload);
+        for (int row = 0; row < CHIP8_SCREEN_HEIGHT; row++) {
+            view.displayBuffer[row] = get_row(payload + 4 + 8 * row);
+        }
+        changed = ~0U;
+        return true;
+    }
+
+    if (type == CHIP8_STREAM_DELTA) {
+        if (length < 8) {
+            return false;
+        }
+        frame = get_long(payload);
+        unsigned int mask = get_long(payload + 4);
+        const byte * rows = payload + 8;
+
+        if (length != 8 + 8 * (size_t) __builtin_popcount(mask)) {
+            return false;
+        }
+        for (int row = 0; row < CHIP8_SCREEN_HEIGHT; row++) {
+            if ((mask >> row) & 1) {
+                view.displayBuffer[row] = get_row(rows);
+                rows += 8;
+            }
+        }
+        changed |= mask;
+        return true;
+    }
+
+    // Unknown types are skipped, so newer servers can add messages
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2) {
+        std::cout << "Usage: ./chip8-view socket" << std::endl;
+        exit(1);
+    }
+
+    int fd = connect_to(argv[1]);
+    if (fd < 0) {
+        std::cout << "Cannot connect to " << argv[1] << ": " << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    byte hello[5];
+    if (!read_fully(fd, hello, sizeof(hello)) || memcmp(hello, CHIP8_STREAM_MAGIC, 4) != 0
+            || hello[4] != CHIP8_STREAM_VERSION) {
+        std::cout << argv[1] << " is not a frame stream" << std::endl;
+        exit(1);
+    }
+
+    Chip8 * view = new Chip8();
+    view->reset();
+
+    setlocale(LC_ALL, "");
+    init_curses();
+
+    WINDOW * display = create_window(FRONTEND_SCREEN_X, FRONTEND_SCREEN_Y, FRONTEND_SCREEN_WIDTH + 2, FRONTEND_SCREEN_HEIGHT + 2);
+    WINDOW * helpbar = create_window(FRONTEND_HELPBAR_X, FRONTEND_HELPBAR_Y, FRONTEND_HELPBAR_WIDTH + 4, FRONTEND_HELPBAR_HEIGHT + 2);
+    mvwprintw(helpbar, 1, 1, "QUIT: [Esc] KEYS: 1234 QWER ASDF ZXCV");
+    wrefresh(helpbar);
+
+    std::vector<byte> in;
+    long release_at[16] = {};
+    unsigned int frame = 0;
+    const char * ended = "Server closed the stream";
+
+    for (;;) {
+        pollfd wait = { fd, POLLIN, 0 };
+        ::poll(&wait, 1, VIEW_POLL_MS);
+
+        // Take whatever arrived and apply every complete message
+        if (wait.revents & (POLLIN | POLLHUP | POLLERR)) {
+            byte chunk[4096];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) {
+                break;
+            }
+            in.insert(in.end(), chunk, chunk + n);
+
+            unsigned int changed = 0;
+            size_t pos = 0;
+            bool bad = false;
+            while (in.size() - pos >= CHIP8_STREAM_HEADER_BYTES) {
+                size_t length = in[pos + 1] | (in[pos + 2] << 8);
+                if (in.size() - pos < CHIP8_STREAM_HEADER_BYTES + length) {
+                    break;
+                }
+                if (!apply_message(*view, in[pos], &in[pos + CHIP8_STREAM_HEADER_BYTES], length, changed, frame)) {
+                    bad = true;
+                    break;
+                }
+                pos += CHIP8_STREAM_HEADER_BYTES + length;
+            }
+            if (bad) {
+                ended = "Bad message from server";
+                break;
+            }
+            in.erase(in.begin(), in.begin() + pos);
+
+            // Each terminal row shows two pixel rows
+            for (int row = 0; row < FRONTEND_SCREEN_HEIGHT; row++) {
+                if ((changed >> (row * 2)) & 3) {
+                    draw_display_row(display, *view, row);
+                }
+            }
+            if (changed) {
+                mvwprintw(helpbar, 1, FRONTEND_HELPBAR_WIDTH - 14, "FRAME %8u", frame);
+                wnoutrefresh(display);
+                wnoutrefresh(helpbar);
+                doupdate();
+            }
+        }
+
+        int ch = getch();
+        if (ch == 27) {
+            ended = nullptr;
+            break;
+        }
+
+        long now = now_ns();
+        int key = ch == ERR ? -1 : map_to_keypad(ch);
+        if (key != -1) {
+            byte event = key | CHIP8_STREAM_KEY_DOWN;
+            if (send(fd, &event, 1, MSG_NOSIGNAL) != 1) {
+                break;
+            }
+            release_at[key] = now + VIEW_KEY_HOLD_NS;
+        }
+        for (int i = 0; i < 16; i++) {
+            if (release_at[i] && now >= release_at[i]) {
+                byte event = i;
+                send(fd, &event, 1, MSG_NOSIGNAL);
+                release_at[i] = 0;
+            }
+        }
+    }
+
+    endwin();
+    close(fd);
+    if (ended) {
+        std::cout << ended << std::endl;
+    }
+    return 0;
+}
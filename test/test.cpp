@@ -0,0 +1,323 @@
+#ifdef CHIP8_CATCH2_V2
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+#else
+#include <catch2/catch_test_macros.hpp>
+#endif
+
+#include "chip8env.hpp"
+#include "chip8live.hpp"
+#include "chip8rom.hpp"
+#include "chip8stream.hpp"
+#include "frontend.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Waits for a key with FX0A, then draws the 8x8 sprite at 0x210 and spins
+static std::vector<byte> keyRom() {
+    static const byte program[] = {
+        0xF0, 0x0A, 0xA2, 0x10, 0x61, 0x00, 0xD1, 0x18,
+        0x12, 0x08,
+    };
+    std::vector<byte> rom(CHIP8_ROM_BYTES);
+    memcpy(rom.data(), program, sizeof(program));
+    memset(rom.data() + 0x10, 0xFF, 8);
+    return rom;
+}
+
+TEST_CASE("Chip8Env steps, observes and resets", "[env]") {
+    std::vector<byte> rom = keyRom();
+    Chip8Env * env = new Chip8Env(rom.data());
+
+    REQUIRE((uintptr_t) &env->machine % alignof(Chip8) == 0);
+
+    byte blank[CHIP8_ENV_FRAME_BYTES] = {};
+    unsigned long first = env->reset();
+    REQUIRE(first == hashFrame(blank));
+
+    // No key held: still waiting, nothing drawn
+    Chip8StepResult idle = env->step(0, 2);
+    REQUIRE(idle.frameHash == first);
+    REQUIRE(!idle.done);
+    REQUIRE(env->machine.blockingForKey);
+
+    // FX0A takes key 5 once it is pressed and released, then the sprite draws
+    REQUIRE(env->step(1 << 5, 1).frameHash == first);
+    Chip8StepResult drawn = env->step(0, 2);
+    REQUIRE(drawn.frameHash != first);
+    REQUIRE(!drawn.done);
+    REQUIRE(env->machine.variableRegisters[0] == 5);
+    REQUIRE(env->observation()[0] == 0xFF);
+
+    REQUIRE(env->reset() == first);
+    REQUIRE(env->machine.programCounter == 0x200);
+    REQUIRE(env->step(0, 1).frameHash == first);
+
+    delete env;
+}
+
+TEST_CASE("Chip8Env ends the episode on a fault", "[env]") {
+    std::vector<byte> rom(CHIP8_ROM_BYTES);
+    rom[0] = 0x00;
+    rom[1] = 0xEE;      // Return with an empty stack
+    Chip8Env env(rom.data());
+
+    env.doneHook = [](const Chip8 &) { return false; };
+    REQUIRE(env.step(0, 1).done);
+    REQUIRE(env.machine.fault == CHIP8_FAULT_STACK_UNDERFLOW);
+}
+
+TEST_CASE("Chip8SharedFrames reopens and checks the slot count", "[env]") {
+    const char * name = "/chiptest-frames";
+    Chip8SharedFrames producer, learner;
+
+    REQUIRE(producer.open(name, 4, true));
+    REQUIRE(producer.open(name, 2, true));
+    REQUIRE(producer.slots() == 2);
+    producer.slot(1)[0] = 0xA5;
+
+    REQUIRE(!learner.open(name, 4, false));
+    REQUIRE(errno == EINVAL);
+    REQUIRE(learner.open(name, 2, false));
+    REQUIRE(learner.slot(1)[0] == 0xA5);
+
+    Chip8SharedFrames::unlink(name);
+}
+
+TEST_CASE("Break specs take exact operators and in-range values", "[debug]") {
+    Chip8 machine;
+    Chip8Debugger debugger(machine);
+
+    const char * good[] = { "2a4", "fff", "v3==05", "V3!=5", "va<10", "vA<=10", "2a4:v3>1", "2a4:vf>=ff" };
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+        INFO(good[i]);
+        REQUIRE(parse_break_spec(debugger, good[i]));
+    }
+
+    const char * bad[] = { "", "1000", "2a4x", "2a4:", "v3=5", "v3=!5", "v3<>5", "v3!<5",
+        "v3==100", "v3==5x", "vg==5", "1000:v3==5", "v3=<5" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        INFO(bad[i]);
+        REQUIRE(!parse_break_spec(debugger, bad[i]));
+    }
+}
+
+TEST_CASE("<= and >= conditions stop on the boundary", "[debug]") {
+    Chip8 machine;
+    Chip8Debugger debugger(machine);
+    std::vector<byte> rom(CHIP8_ROM_BYTES);
+    const byte program[] = { 0x70, 0x01, 0x12, 0x00 };     // V0 += 1, loop
+    memcpy(rom.data(), program, sizeof(program));
+    machine.load(rom.data());
+
+    REQUIRE(parse_break_spec(debugger, "v0>=3"));
+    debugger.run(100);
+    REQUIRE(debugger.stopReason == CHIP8_STOP_CONDITION);
+    REQUIRE(machine.variableRegisters[0] == 3);
+
+    debugger.clear();
+    machine.reset();
+    machine.load(rom.data());
+    REQUIRE(parse_break_spec(debugger, "200:v0<=0"));
+    debugger.run(100);
+    REQUIRE(debugger.stopReason == CHIP8_STOP_CONDITION);
+    REQUIRE(machine.variableRegisters[0] == 0);
+}
+
+TEST_CASE("Conditions stop once per false to true edge", "[debug]") {
+    Chip8 machine;
+    Chip8Debugger debugger(machine);
+    std::vector<byte> rom(CHIP8_ROM_BYTES);
+    // V3 = 5 for a few instructions, then 6, then back to 5
+    const byte program[] = { 0x63, 0x05, 0x60, 0x00, 0x60, 0x00, 0x63, 0x06, 0x63, 0x05, 0x12, 0x0A };
+    memcpy(rom.data(), program, sizeof(program));
+    machine.load(rom.data());
+
+    REQUIRE(parse_break_spec(debugger, "v3==5"));
+
+    REQUIRE(debugger.run(100) == 1);
+    REQUIRE(debugger.stopReason == CHIP8_STOP_CONDITION);
+    REQUIRE(machine.programCounter == 0x202);
+
+    // Still true: single steps go on instead of stopping again
+    for (int i = 0; i < 3; i++) {
+        REQUIRE(debugger.run(1) == 1);
+        REQUIRE(debugger.stopReason == CHIP8_STOP_NONE);
+    }
+    REQUIRE(machine.programCounter == 0x208);
+
+    // 6 then 5 again is a new edge
+    REQUIRE(debugger.run(100) == 1);
+    REQUIRE(debugger.stopReason == CHIP8_STOP_CONDITION);
+    REQUIRE(machine.programCounter == 0x20A);
+
+    // The loop at 20A keeps it true forever: no more stops
+    REQUIRE(debugger.run(100) == 100);
+}
+
+TEST_CASE("Live readers refuse short and foreign segments", "[live]") {
+    const char * name = "/chiptest-live";
+    Chip8LiveExport reader;
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    REQUIRE(fd >= 0);
+    REQUIRE(ftruncate(fd, 16) == 0);
+    REQUIRE(!reader.open(name, false));
+    REQUIRE(errno == EINVAL);
+
+    // Long enough, but zeroed rather than published to
+    REQUIRE(ftruncate(fd, sizeof(Chip8LiveSegment)) == 0);
+    REQUIRE(!reader.open(name, false));
+    REQUIRE(errno == EINVAL);
+    close(fd);
+    Chip8LiveExport::unlink(name);
+
+    Chip8LiveExport publisher;
+    Chip8 machine;
+    machine.programCounter = 0x2A4;
+    REQUIRE(publisher.open(name, true));
+    publisher.publish(machine);
+
+    Chip8LiveState state;
+    REQUIRE(reader.open(name, false));
+    REQUIRE(reader.read(state));
+    REQUIRE(state.programCounter == 0x2A4);
+    REQUIRE(state.frame == 1);
+    Chip8LiveExport::unlink(name);
+}
+
+// A ROM file in a fresh directory, which doubles as the analysis cache
+static std::string write_rom(const byte * program, size_t size, std::string &dir) {
+    char temp[] = "/tmp/chiptest-XXXXXX";
+    REQUIRE(mkdtemp(temp));
+    dir = temp;
+
+    std::string path = dir + "/test.ch8";
+    FILE * out = fopen(path.c_str(), "wb");
+    REQUIRE(out);
+    fwrite(program, 1, size, out);
+    fclose(out);
+    return path;
+}
+
+TEST_CASE("Analysis cache entries with out-of-range fields are re-analysed", "[rom]") {
+    const byte program[] = { 0x70, 0x01, 0x12, 0x02 };     // V0 += 1, spin at 202
+    std::string dir;
+    std::string romPath = write_rom(program, sizeof(program), dir);
+
+    Chip8Rom rom;
+    REQUIRE(rom.open(romPath.c_str()));
+    Chip8RomAnalysis first;
+    REQUIRE(!first.loadOrAnalyze(rom, dir));
+    REQUIRE(first.spinsAt(0x202));
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016lx.c8a", rom.hash());
+    std::string cachePath = dir + name;
+
+    Chip8IdleSite farSite = { 0xFFC0, CHIP8_IDLE_SPIN };
+    Chip8IdleSite badKind = { 0x202, (Chip8IdleKind) 7 };
+    Chip8BasicBlock badExit = { 0x200, 0x204, (Chip8BlockExit) 9 };
+    Chip8BasicBlock empty = { 0x204, 0x204, CHIP8_EXIT_JUMP };
+
+    for (int corruption = 0; corruption < 4; corruption++) {
+        Chip8RomAnalysis bad = first;
+        switch (corruption) {
+            case 0: bad.idleSites.push_back(farSite); break;
+            case 1: bad.idleSites.push_back(badKind); break;
+            case 2: bad.blocks.push_back(badExit); break;
+            case 3: bad.blocks.push_back(empty); break;
+        }
+        REQUIRE(bad.save(cachePath));
+
+        Chip8RomAnalysis again;
+        INFO("corruption " << corruption);
+        REQUIRE(!again.load(cachePath, rom.hash()));
+        REQUIRE(!again.loadOrAnalyze(rom, dir));
+        REQUIRE(again.spinsAt(0x202));
+        REQUIRE(again.idleSites.size() == first.idleSites.size());
+    }
+
+    // The rewritten entry is good again
+    Chip8RomAnalysis cached;
+    REQUIRE(cached.loadOrAnalyze(rom, dir));
+
+    unlink(cachePath.c_str());
+    unlink(romPath.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST_CASE("Headless runs don't stop at a spin the program has overwritten", "[rom]") {
+    const byte program[] = { 0x70, 0x01, 0x12, 0x02 };
+    std::string dir;
+    std::string romPath = write_rom(program, sizeof(program), dir);
+
+    Chip8Rom rom;
+    REQUIRE(rom.open(romPath.c_str()));
+    Chip8RomAnalysis analysis;
+    analysis.analyze(rom);
+
+    chip_frontend fe = {};
+    fe.sys = new Chip8();
+    fe.debugger = new Chip8Debugger(*fe.sys);
+    fe.analysis = &analysis;
+
+    // As analysed: one add, then idle at the spin
+    fe.sys->load(rom.data());
+    REQUIRE(run_headless(fe, 1000) == 0);
+    REQUIRE(fe.sys->variableRegisters[0] == 1);
+    REQUIRE(fe.sys->programCounter == 0x202);
+
+    // The spin replaced by a jump back to the add: never idle
+    fe.sys->reset();
+    fe.sys->load(rom.data());
+    fe.sys->ram[0x203] = 0x00;
+    REQUIRE(run_headless(fe, 1000) == 0);
+    REQUIRE(fe.sys->variableRegisters[0] == (byte) 500);
+
+    delete fe.debugger;
+    delete fe.sys;
+    unlink(romPath.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST_CASE("Stream sockets are owner-only and never replace other files", "[stream]") {
+    char temp[] = "/tmp/chiptest-XXXXXX";
+    REQUIRE(mkdtemp(temp));
+    std::string dir = temp;
+    std::string socketPath = dir + "/c8.sock";
+    std::string filePath = dir + "/notes.txt";
+
+    mode_t old = umask(0);
+    Chip8StreamServer server;
+    REQUIRE(server.open(socketPath.c_str()));
+    umask(old);
+
+    struct stat info;
+    REQUIRE(stat(socketPath.c_str(), &info) == 0);
+    REQUIRE((info.st_mode & 0777) == 0600);
+
+    // Another server can't take over a live socket
+    Chip8StreamServer second;
+    REQUIRE(!second.open(socketPath.c_str()));
+    REQUIRE(errno == EADDRINUSE);
+
+    FILE * out = fopen(filePath.c_str(), "w");
+    REQUIRE(out);
+    fclose(out);
+    REQUIRE(!second.open(filePath.c_str()));
+    REQUIRE(errno == EADDRINUSE);
+    REQUIRE(stat(filePath.c_str(), &info) == 0);
+
+    server.close();
+    REQUIRE(stat(socketPath.c_str(), &info) != 0);
+    unlink(filePath.c_str());
+    rmdir(dir.c_str());
+}